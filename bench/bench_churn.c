@@ -0,0 +1,280 @@
+/* ***********************************************
+ * FILE:       bench_churn.c
+ * PURPOSE:    PROCESS CHURN STRESS HARNESS
+ *             fills the process table until fork() fails and drains it
+ *             again, over and over, mixing in the other operation a
+ *             quarter of the time. Every child blocks until it is woken,
+ *             then it is either joined, or zapped by a helper first
+ *             every window prints a CHURN line with the latency of each
+ *             operation, the heap in use and the table occupancy. The run
+ *             fails if the heap or the capacity of an empty table drifts,
+ *             or if an operation got slower by more than DRIFT times
+ *
+ *             BENCH_SECONDS	length of the run, 10
+ *             BENCH_WINDOW_MS	length of a window, 1000
+ *             BENCH_HEAP_SLACK	bytes the empty-table heap may grow, 65536
+ * ***********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <usloss.h>
+#include "phase1.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define SECONDS		10
+#define WINDOWMS	1000
+#define HEAPSLACK	65536
+#define DRIFT		3		// last quarter against first quarter, mean latency
+#define DRIFTFLOOR	5		// microseconds of drift always allowed
+#define HISTSIZE	1024	// one bucket per microsecond, the last holds the rest
+#define MAXWINDOWS	100000
+#define BLOCKED		20		// blockMe() status, must be above 10
+
+#define FORK		0
+#define JOIN		1
+#define ZAP			2
+#define NUMOPS		3
+
+typedef struct opStats {
+	int count;
+	long total;
+	int max;
+	int hist[HISTSIZE];
+} opStats;
+
+static char *opNames[] = {"fork", "join", "zap"};
+static opStats window[NUMOPS];
+static double *means[NUMOPS];	// mean latency of every window
+static int numWindows = 0;
+static int *live;				// children blocked in linger()
+static int numLive = 0;
+static int liveSize = 0;		// the table grows, so live[] does too
+static unsigned int seed = 12345;
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+int benchTime(void);
+int envInt(char *name, int value);
+unsigned int nextRandom(void);
+int churnFork(void);
+void churnReap(void);
+void opRecord(int op, int value);
+int opPercentile(opStats *stats, int percent);
+void windowReport(long elapsed, int capacity);
+int driftCheck(void);
+long heapInUse(void);
+int linger(char *arg);
+int zapper(char *arg);
+/* ------------------------------------------------------------------------- */
+
+int testcase_main(void) {
+	int seconds = envInt("BENCH_SECONDS", SECONDS);
+	int windowUs = envInt("BENCH_WINDOW_MS", WINDOWMS) * 1000;
+	long slack = envInt("BENCH_HEAP_SLACK", HEAPSLACK);
+	long total = seconds * 1000000L / windowUs;
+	if (total > MAXWINDOWS) total = MAXWINDOWS;
+	for (int op = 0; op < NUMOPS; op++) means[op] = calloc(total, sizeof(double));
+	// the clock wraps after 35 minutes, only differences are taken
+	unsigned int windowStart = benchTime();
+	long elapsed = 0;
+	int filling = 1;
+	int capacity = -1, firstCapacity = -1;
+	long firstHeap = -1;
+	int failed = 0;
+	while (numWindows < total && ! failed) {
+		// a quarter of the steps go against the current direction
+		int grow = (nextRandom() % 4 != 0) == filling;
+		if (grow) {
+			if (! churnFork()) {
+				// full, a shrinking capacity means slots leak
+				capacity = numLive;
+				if (firstCapacity == -1) firstCapacity = capacity;
+				if (capacity < firstCapacity) {
+					USLOSS_Console("CHURN FAIL table capacity fell from %d to %d\n",
+									firstCapacity, capacity);
+					failed = 1;
+				}
+				filling = 0;
+			}
+		} else if (numLive > 0) churnReap();
+		// empty again, everything the kernel allocated for children is free
+		if (! filling && numLive == 0) {
+			long heap = heapInUse();
+			if (firstHeap == -1) firstHeap = heap;
+			if (heap > firstHeap + slack) {
+				USLOSS_Console("CHURN FAIL empty-table heap grew from %ld to %ld bytes\n",
+								firstHeap, heap);
+				failed = 1;
+			}
+			filling = 1;
+		}
+		unsigned int now = benchTime();
+		if (now - windowStart >= (unsigned int)windowUs) {
+			elapsed += now - windowStart;
+			windowReport(elapsed, capacity);
+			windowStart = now;
+		}
+	}
+	while (numLive > 0) churnReap();
+	if (! failed) failed = driftCheck();
+	if (! failed) USLOSS_Console("CHURN PASS windows=%d\n", numWindows);
+	return failed;
+}
+
+/*
+ * @return: the environment variable as a number, value if it is not set
+ */
+int envInt(char *name, int value) {
+	char *str = getenv(name);
+	if (str == NULL || atoi(str) <= 0) return value;
+	return atoi(str);
+}
+
+/*
+ * xorshift32
+ */
+unsigned int nextRandom(void) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+/*
+ * Fork a child, it runs at once and blocks
+ * @return: 0 if the table is full, 1 otherwise
+ */
+int churnFork(void) {
+	int start = benchTime();
+	int pid = fork("linger", linger, "", USLOSS_MIN_STACK, 4);
+	if (pid < 0) return 0;
+	opRecord(FORK, benchTime() - start);
+	if (numLive == liveSize) {
+		liveSize = liveSize ? liveSize * 2 : 64;
+		live = realloc(live, liveSize * sizeof(int));
+	}
+	live[numLive++] = pid;
+	return 1;
+}
+
+/*
+ * Reap a random child: wake it and join it, or half the time have a zapper
+ * zap it first. A zapper needs a free slot, with none the child is joined
+ */
+void churnReap(void) {
+	int i = nextRandom() % numLive;
+	int victim = live[i];
+	live[i] = live[--numLive];
+	int status;
+	int zapping = 0;
+	if (nextRandom() % 2) {
+		char arg[16];
+		snprintf(arg, sizeof(arg), "%d", victim);
+		// the zapper runs at once and blocks in zap()
+		zapping = fork("zapper", zapper, arg, USLOSS_MIN_STACK, 3) > 0;
+	}
+	unblockProc(victim);
+	int start = benchTime();
+	int pid = join(&status);
+	if (! zapping) opRecord(JOIN, benchTime() - start);
+	else join(&status);
+	if (! zapping && pid != victim) {
+		USLOSS_Console("CHURN FAIL joined %d, expected %d\n", pid, victim);
+		USLOSS_Halt(1);
+	}
+}
+
+void opRecord(int op, int value) {
+	opStats *stats = &window[op];
+	stats -> count++;
+	stats -> total += value;
+	if (value > stats -> max) stats -> max = value;
+	stats -> hist[value < HISTSIZE ? value : HISTSIZE - 1]++;
+}
+
+/*
+ * @return: the nearest-rank percentile, HISTSIZE - 1 stands for anything
+ * at or above it
+ */
+int opPercentile(opStats *stats, int percent) {
+	int rank = (stats -> count * percent + 99) / 100;
+	int seen = 0;
+	for (int i = 0; i < HISTSIZE; i++) {
+		seen += stats -> hist[i];
+		if (seen >= rank && seen > 0) return i;
+	}
+	return 0;
+}
+
+/*
+ * Print one CHURN line, keep the window's means and start a new window
+ */
+void windowReport(long elapsed, int capacity) {
+	char line[512];
+	int len = snprintf(line, sizeof(line), "CHURN window=%d elapsed_us=%ld",
+						numWindows, elapsed);
+	for (int op = 0; op < NUMOPS; op++) {
+		opStats *stats = &window[op];
+		double mean = stats -> count ? (double)stats -> total / stats -> count : 0;
+		means[op][numWindows] = mean;
+		len += snprintf(line + len, sizeof(line) - len,
+						" %s_ops=%d %s_mean_us=%.2f %s_p99_us=%d %s_max_us=%d",
+						opNames[op], stats -> count, opNames[op], mean,
+						opNames[op], opPercentile(stats, 99), opNames[op],
+						stats -> max);
+	}
+	USLOSS_Console("%s heap_bytes=%ld live=%d capacity=%d\n", line,
+					heapInUse(), numLive, capacity);
+	memset(window, 0, sizeof(window));
+	numWindows++;
+}
+
+/*
+ * Compare the mean latency of the last quarter of the windows with the
+ * first quarter, the first window is warm-up and left out
+ * @return: 1 if an operation drifted, 0 otherwise
+ */
+int driftCheck(void) {
+	int quarter = (numWindows - 1) / 4;
+	if (quarter == 0) return 0;
+	int failed = 0;
+	for (int op = 0; op < NUMOPS; op++) {
+		double first = 0, last = 0;
+		for (int i = 0; i < quarter; i++) {
+			first += means[op][1 + i];
+			last += means[op][numWindows - quarter + i];
+		}
+		first /= quarter;
+		last /= quarter;
+		if (last > first * DRIFT + DRIFTFLOOR) {
+			USLOSS_Console("CHURN FAIL %s mean latency drifted from %.2f to %.2f us\n",
+							opNames[op], first, last);
+			failed = 1;
+		}
+	}
+	return failed;
+}
+
+/*
+ * @return: bytes the host allocator has handed out and not got back
+ */
+long heapInUse(void) {
+	return mallinfo2().uordblks;
+}
+
+int linger(char *arg) {
+	blockMe(BLOCKED);
+	return 0;
+}
+
+/*
+ * Time zap() from the call to the child quitting
+ */
+int zapper(char *arg) {
+	int start = benchTime();
+	zap(atoi(arg));
+	opRecord(ZAP, benchTime() - start);
+	return 0;
+}
@@ -0,0 +1,205 @@
+/* ***********************************************
+ * FILE:       bench_disk.c
+ * PURPOSE:    DISK WORKLOAD GENERATOR
+ *             M user processes issue DiskRead()/DiskWrite() of 1 to N
+ *             blocks over both units, at block addresses that are
+ *             sequential, uniformly random or zipfian, for each pattern in
+ *             turn. Every request's latency goes into a BENCH line, and a
+ *             DISK line with the same name adds MB/s and the tracks the
+ *             heads crossed
+ *
+ *             BENCH_PROCS		processes, 4
+ *             BENCH_READ_PCT	percent of requests that read, 70
+ *             BENCH_MAX_BLOCKS	largest request in blocks, 8
+ *             BENCH_PATTERN	seq, random or zipf, all three if unset
+ *             BENCH_ITERS		requests per process, 500
+ * ***********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <usloss.h>
+#include "phase4.h"
+#include "phase3_usermode.h"
+#include "phase4_usermode.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define ITERS		500
+#define PROCS		4
+#define READPCT		70
+#define MAXBLOCKS	8		// at most a track
+#define MAXPROCS	64		// workers, far below what the process table holds
+#define ZIPFTHETA	0.99	// skew, as in YCSB
+#define SCATTER		7919	// prime, spreads the hot blocks over the disk
+#define POLICY		"cscan"	// diskDriver()'s only policy
+
+#define SEQ			0
+#define RANDOM		1
+#define ZIPF		2
+
+static char *patternNames[] = {"seq", "random", "zipf"};
+static int pattern;
+static int procs, readPct, maxBlocks, iters;
+static int diskBlocks[USLOSS_DISK_UNITS];	// blocks on each unit
+static double *zipfCDF[USLOSS_DISK_UNITS];	// P(rank <= i) for each unit
+static int latencyID;
+static long long bytes;		// moved by the current workload
+static int failed;			// requests that did not come back READY
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+int benchTime(void);
+int benchIters(int iters);
+int benchOpen(char *name, int iters);
+void benchBegin(int id);
+void benchSample(int id, int value);
+void benchReport(int id);
+void dumpStats();
+int envInt(char *name, int value);
+void runWorkload(int which);
+int worker(char *arg);
+unsigned int nextRandom(unsigned int *state);
+int pickBlock(int id, int unit, int blocks, int *cursor, unsigned int *seed);
+double *buildZipf(int n);
+/* ------------------------------------------------------------------------- */
+
+int testcase_main(void) {
+	procs = envInt("BENCH_PROCS", PROCS);
+	readPct = envInt("BENCH_READ_PCT", READPCT);
+	maxBlocks = envInt("BENCH_MAX_BLOCKS", MAXBLOCKS);
+	iters = benchIters(ITERS);
+	if (maxBlocks < 1 || maxBlocks > USLOSS_DISK_TRACK_SIZE) 
+		maxBlocks = MAXBLOCKS;
+	if (procs > MAXPROCS) procs = MAXPROCS;
+	for (int unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+		int sector, track, disk;
+		DiskSize(unit, &sector, &track, &disk);
+		diskBlocks[unit] = track * disk;
+		zipfCDF[unit] = buildZipf(diskBlocks[unit]);
+	}
+	char *only = getenv("BENCH_PATTERN");
+	for (int i = SEQ; i <= ZIPF; i++)
+		if (only == NULL || strcmp(only, patternNames[i]) == 0) runWorkload(i);
+	dumpStats();
+	return failed != 0;
+}
+
+/*
+ * @return: the environment variable as a number, value if it is not set
+ */
+int envInt(char *name, int value) {
+	char *str = getenv(name);
+	if (str == NULL || atoi(str) < 0) return value;
+	return atoi(str);
+}
+
+/*
+ * Run every worker on one pattern and report it
+ */
+void runWorkload(int which) {
+	char name[MAXNAME];
+	int pid, status;
+	snprintf(name, MAXNAME, "disk_%s_%dp_%dr", patternNames[which], procs,
+				readPct);
+	pattern = which;
+	bytes = 0;
+	latencyID = benchOpen(name, procs * iters);
+	long long seeks = 0;
+	for (int unit = 0; unit < USLOSS_DISK_UNITS; unit++)
+		seeks -= standinSeekTracks(unit);
+	int start = benchTime();
+	for (int i = 0; i < procs; i++) {
+		char arg[16];
+		snprintf(arg, sizeof(arg), "%d", i);
+		Spawn("worker", worker, arg, USLOSS_MIN_STACK, 3, &pid);
+	}
+	for (int i = 0; i < procs; i++) Wait(&pid, &status);
+	int elapsed = benchTime() - start;
+	for (int unit = 0; unit < USLOSS_DISK_UNITS; unit++)
+		seeks += standinSeekTracks(unit);
+	benchReport(latencyID);
+	USLOSS_Console("DISK name=%s policy=%s pattern=%s procs=%d read_pct=%d max_blocks=%d bytes=%lld mb_per_sec=%.2f seek_tracks=%lld\n",
+					name, POLICY, patternNames[which], procs, readPct,
+					maxBlocks, bytes,
+					elapsed > 0 ? (double)bytes / elapsed : 0.0, seeks);
+}
+
+/*
+ * Issue iters requests, worker i stays on unit i % USLOSS_DISK_UNITS and a
+ * sequential worker starts at its own share of the disk
+ */
+int worker(char *arg) {
+	int id = atoi(arg);
+	int unit = id % USLOSS_DISK_UNITS;
+	unsigned int seed = 2654435761u * (id + 1);
+	int cursor = diskBlocks[unit] / procs * id;
+	char *buffer = malloc(maxBlocks * USLOSS_DISK_SECTOR_SIZE);
+	memset(buffer, id, maxBlocks * USLOSS_DISK_SECTOR_SIZE);
+	for (int i = 0; i < iters; i++) {
+		int blocks = 1 + nextRandom(&seed) % maxBlocks;
+		int block = pickBlock(id, unit, blocks, &cursor, &seed);
+		int track = block / USLOSS_DISK_TRACK_SIZE;
+		int first = block % USLOSS_DISK_TRACK_SIZE;
+		int status;
+		int start = benchTime();
+		if ((int)(nextRandom(&seed) % 100) < readPct)
+			DiskRead(buffer, unit, track, first, blocks, &status);
+		else
+			DiskWrite(buffer, unit, track, first, blocks, &status);
+		benchSample(latencyID, benchTime() - start);
+		if (status != USLOSS_DEV_READY) failed++;
+		bytes += blocks * USLOSS_DISK_SECTOR_SIZE;
+	}
+	free(buffer);
+	return 0;
+}
+
+/*
+ * xorshift32
+ */
+unsigned int nextRandom(unsigned int *state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/*
+ * @return: the first block of a request that fits on the unit
+ */
+int pickBlock(int id, int unit, int blocks, int *cursor, unsigned int *seed) {
+	int last = diskBlocks[unit] - blocks;	// highest first block that fits
+	if (pattern == SEQ) {
+		if (*cursor > last) *cursor = 0;
+		int block = *cursor;
+		*cursor += blocks;
+		return block;
+	}
+	if (pattern == RANDOM) return nextRandom(seed) % (last + 1);
+	// binary search the CDF for the rank, then scatter it
+	double u = (nextRandom(seed) & 0xffffff) / (double)0x1000000;
+	double *cdf = zipfCDF[unit];
+	int low = 0, high = diskBlocks[unit] - 1;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (cdf[mid] < u) low = mid + 1;
+		else high = mid;
+	}
+	return (int)((long)low * SCATTER % (last + 1));
+}
+
+/*
+ * @return: the cumulative zipfian distribution over n ranks
+ */
+double *buildZipf(int n) {
+	double *cdf = malloc(n * sizeof(double));
+	double sum = 0;
+	for (int i = 0; i < n; i++) {
+		sum += 1.0 / pow(i + 1, ZIPFTHETA);
+		cdf[i] = sum;
+	}
+	for (int i = 0; i < n; i++) cdf[i] /= sum;
+	return cdf;
+}
@@ -0,0 +1,123 @@
+/* ***********************************************
+ * FILE:       bench_mbox.c
+ * PURPOSE:    MAILBOX LATENCY
+ *             SendMbox()/ReceiveMbox() ping-pong on zero-slot and
+ *             N-slot mailboxes, and CondSendMbox() from the clock
+ *             interrupt handler to a waiting receiver
+ * ***********************************************/
+
+#include <usloss.h>
+#include "phase2.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define ITERS		100000
+#define INTRITERS	500		// one per clock interrupt
+#define SLOTS		10
+
+static int pingBox, pongBox;
+static int intrBox = -1;
+static int intrSendID;
+static void (*clockHandler)(int dev, void *arg);
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+int benchTime(void);
+int benchIters(int iters);
+int benchOpen(char *name, int iters);
+void benchBegin(int id);
+void benchSample(int id, int value);
+void benchReport(int id);
+void dumpStats();
+void pingPong(char *name, int slots);
+int ping(char *arg);
+int pong(char *arg);
+void condSendClock(int dev, void *arg);
+int intrReceiver(char *arg);
+/* ------------------------------------------------------------------------- */
+
+int testcase_main(void) {
+	pingPong("mbox_pingpong_0slot_roundtrip", 0);
+	pingPong("mbox_pingpong_nslot_roundtrip", SLOTS);
+	// every clock interrupt sends the time it fired to intrReceiver
+	int status;
+	int iters = benchIters(INTRITERS);
+	intrSendID = benchOpen("mbox_condsend_intr", iters);
+	intrBox = CreateMbox(SLOTS, sizeof(int));
+	clockHandler = USLOSS_IntVec[USLOSS_CLOCK_INT];
+	USLOSS_IntVec[USLOSS_CLOCK_INT] = condSendClock;
+	fork("intrReceiver", intrReceiver, "", USLOSS_MIN_STACK, 4);
+	join(&status);
+	USLOSS_IntVec[USLOSS_CLOCK_INT] = clockHandler;
+	benchReport(intrSendID);
+	dumpStats();
+	return 0;
+}
+
+/*
+ * Run one ping-pong benchmark between two processes at the same priority
+ */
+void pingPong(char *name, int slots) {
+	int status;
+	pingBox = CreateMbox(slots, sizeof(int));
+	pongBox = CreateMbox(slots, sizeof(int));
+	fork("pong", pong, "", USLOSS_MIN_STACK, 4);
+	fork("ping", ping, name, USLOSS_MIN_STACK, 4);
+	join(&status);
+	join(&status);
+	ReleaseMbox(pingBox);
+	ReleaseMbox(pongBox);
+}
+
+/*
+ * Round trip: one message to pong and its reply, -1 tells pong to stop
+ */
+int ping(char *arg) {
+	int iters = benchIters(ITERS);
+	int id = benchOpen(arg, iters);
+	int msg;
+	for (int i = 0; i < iters; i++) {
+		int start = benchTime();
+		SendMbox(pingBox, &i, sizeof(int));
+		ReceiveMbox(pongBox, &msg, sizeof(int));
+		benchSample(id, benchTime() - start);
+	}
+	benchReport(id);
+	msg = -1;
+	SendMbox(pingBox, &msg, sizeof(int));
+	return 0;
+}
+
+int pong(char *arg) {
+	int msg;
+	while (1) {
+		ReceiveMbox(pingBox, &msg, sizeof(int));
+		if (msg == -1) break;
+		SendMbox(pongBox, &msg, sizeof(int));
+	}
+	return 0;
+}
+
+/*
+ * Part 1's clock handler, then time a CondSendMbox() from interrupt context
+ */
+void condSendClock(int dev, void *arg) {
+	clockHandler(dev, arg);
+	int start = benchTime();
+	CondSendMbox(intrBox, &start, sizeof(int));
+	benchSample(intrSendID, benchTime() - start);
+}
+
+/*
+ * Time from the interrupt to the receiver running with the message
+ */
+int intrReceiver(char *arg) {
+	int iters = benchIters(INTRITERS);
+	int id = benchOpen("mbox_condsend_intr_delivery", iters);
+	int sent;
+	for (int i = 0; i < iters; i++) {
+		ReceiveMbox(intrBox, &sent, sizeof(int));
+		benchSample(id, benchTime() - sent);
+	}
+	benchReport(id);
+	return 0;
+}
@@ -0,0 +1,100 @@
+/* ***********************************************
+ * FILE:       bench_sem.c
+ * PURPOSE:    SEMAPHORE LATENCY
+ *             SemP()/SemV() on a semaphore that never blocks, and a
+ *             ping-pong over two semaphores where every SemP() blocks
+ *             the processes run in user mode, so every sample includes 
+ *             one GetTimeofDay() syscall
+ * ***********************************************/
+
+#include <usloss.h>
+#include "phase3.h"
+#include "phase3_usermode.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define ITERS		100000
+
+static int pingSem, pongSem;
+static int done = 0;
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+int benchTime(void);
+int benchIters(int iters);
+int benchOpen(char *name, int iters);
+void benchBegin(int id);
+void benchSample(int id, int value);
+void benchReport(int id);
+void dumpStats();
+int uncontended(char *arg);
+int ping(char *arg);
+int pong(char *arg);
+/* ------------------------------------------------------------------------- */
+
+int testcase_main(void) {
+	int pid, status;
+	Spawn("uncontended", uncontended, "", USLOSS_MIN_STACK, 4, &pid);
+	Wait(&pid, &status);
+	SemCreate(0, &pingSem);
+	SemCreate(0, &pongSem);
+	Spawn("pong", pong, "", USLOSS_MIN_STACK, 4, &pid);
+	Spawn("ping", ping, "", USLOSS_MIN_STACK, 4, &pid);
+	Wait(&pid, &status);
+	Wait(&pid, &status);
+	dumpStats();
+	return 0;
+}
+
+/*
+ * A semaphore starting at iters, SemP() down to 0 and SemV() back up never
+ * blocks
+ */
+int uncontended(char *arg) {
+	int iters = benchIters(ITERS);
+	int p = benchOpen("sem_p_uncontended", iters);
+	int v = benchOpen("sem_v_uncontended", iters);
+	int sem;
+	SemCreate(iters, &sem);
+	benchBegin(p);
+	for (int i = 0; i < iters; i++) {
+		int start = benchTime();
+		SemP(sem);
+		benchSample(p, benchTime() - start);
+	}
+	benchReport(p);
+	benchBegin(v);
+	for (int i = 0; i < iters; i++) {
+		int start = benchTime();
+		SemV(sem);
+		benchSample(v, benchTime() - start);
+	}
+	benchReport(v);
+	return 0;
+}
+
+/*
+ * Round trip: wake pong and block until it wakes us back
+ */
+int ping(char *arg) {
+	int iters = benchIters(ITERS);
+	int id = benchOpen("sem_pv_contended_roundtrip", iters);
+	for (int i = 0; i < iters; i++) {
+		int start = benchTime();
+		SemV(pingSem);
+		SemP(pongSem);
+		benchSample(id, benchTime() - start);
+	}
+	benchReport(id);
+	done = 1;
+	SemV(pingSem);
+	return 0;
+}
+
+int pong(char *arg) {
+	while (1) {
+		SemP(pingSem);
+		if (done) break;
+		SemV(pongSem);
+	}
+	return 0;
+}
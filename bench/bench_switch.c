@@ -0,0 +1,152 @@
+/* ***********************************************
+ * FILE:       bench_switch.c
+ * PURPOSE:    DISPATCHER SWITCH AND PROCESS EXIT COST
+ *             two processes at the same priority hand the CPU back and
+ *             forth with unblockProc() and blockMe(), every round trip is
+ *             two dispatcher() switches. It is repeated with the process
+ *             table filled by blocked processes, the switch should cost the
+ *             same however full the table is. A fork() and join() of a
+ *             child that returns at once times creating and clearing a PTE
+ * ***********************************************/
+
+#include <usloss.h>
+#include "phase1.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define ITERS		100000
+#define BLOCKED		20	// blockMe() status, must be above 10
+#define BYSTANDERS	32	// most blocked processes that fit next to the drivers
+
+static int pingPID, pongPID;
+static int turn;					// PID of the process that should run
+static int waiting[2];				// blocked in handOff(), ping then pong
+static int done = 0;
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+int benchTime(void);
+int benchIters(int iters);
+int benchOpen(char *name, int iters);
+void benchBegin(int id);
+void benchSample(int id, int value);
+void benchReport(int id);
+void dumpStats();
+void switchRun(char *name, int bystanders);
+void forkJoinRun(void);
+int bystander(char *arg);
+int child(char *arg);
+void handOff(int pid);
+void waitTurn(void);
+int ping(char *arg);
+int pong(char *arg);
+/* ------------------------------------------------------------------------- */
+
+int testcase_main(void) {
+	switchRun("dispatch_switch_roundtrip", 0);
+	switchRun("dispatch_switch_roundtrip_16blocked", BYSTANDERS / 2);
+	switchRun("dispatch_switch_roundtrip_32blocked", BYSTANDERS);
+	forkJoinRun();
+	dumpStats();
+	return 0;
+}
+
+/*
+ * Run one ping-pong benchmark with some blocked processes in the table
+ */
+void switchRun(char *name, int bystanders) {
+	int pids[BYSTANDERS];
+	int status;
+	// each bystander runs at once and blocks until the run is over
+	for (int i = 0; i < bystanders; i++)
+		pids[i] = fork("bystander", bystander, "", USLOSS_MIN_STACK, 3);
+	turn = 0;
+	done = 0;
+	// pong runs first and waits for its turn, ping runs next and leads
+	pongPID = fork("pong", pong, "", USLOSS_MIN_STACK, 4);
+	fork("ping", ping, name, USLOSS_MIN_STACK, 4);
+	join(&status);
+	join(&status);
+	for (int i = 0; i < bystanders; i++) {
+		unblockProc(pids[i]);
+		join(&status);
+	}
+}
+
+/*
+ * Round trip: fork() a higher priority child, it runs, returns and is
+ * cleared from the table by join()
+ */
+void forkJoinRun(void) {
+	int iters = benchIters(ITERS);
+	int id = benchOpen("proc_fork_join_roundtrip", iters);
+	int status;
+	for (int i = 0; i < iters; i++) {
+		int start = benchTime();
+		fork("child", child, "", USLOSS_MIN_STACK, 4);
+		join(&status);
+		benchSample(id, benchTime() - start);
+	}
+	benchReport(id);
+}
+
+int bystander(char *arg) {
+	blockMe(BLOCKED);
+	return 0;
+}
+
+int child(char *arg) {
+	return 0;
+}
+
+int ping(char *arg) {
+	// fork() has not returned to testcase_main yet
+	pingPID = getpid();
+	int iters = benchIters(ITERS);
+	int id = benchOpen(arg, iters);
+	for (int i = 0; i < iters; i++) {
+		int start = benchTime();
+		handOff(pongPID);
+		benchSample(id, benchTime() - start);
+	}
+	benchReport(id);
+	done = 1;
+	turn = pongPID;
+	if (waiting[1]) unblockProc(pongPID);
+	return 0;
+}
+
+int pong(char *arg) {
+	waitTurn();
+	while (! done) handOff(pingPID);
+	return 0;
+}
+
+/*
+ * Give pid the turn and block until it gives it back
+ * unblockProc() can end our time slice and run pid before we block, so pid
+ * is only woken if it is blocked
+ */
+void handOff(int pid) {
+	unsigned int psr = USLOSS_PsrGet();
+	USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+	turn = pid;
+	if (waiting[pid == pongPID]) unblockProc(pid);
+	waitTurn();
+	USLOSS_PsrSet(psr);
+}
+
+/*
+ * Block until it is our turn, with interrupts off so no time slice can end
+ * between marking ourselves waiting and blocking
+ */
+void waitTurn(void) {
+	int self = getpid();
+	unsigned int psr = USLOSS_PsrGet();
+	USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+	while (turn != self) {
+		waiting[self == pongPID] = 1;
+		blockMe(BLOCKED);
+		waiting[self == pongPID] = 0;
+	}
+	USLOSS_PsrSet(psr);
+}
@@ -0,0 +1,125 @@
+/* ***********************************************
+ * FILE:       benchlib.c
+ * PURPOSE:    LATENCY SAMPLES AND REPORTS FOR THE BENCHMARK PROGRAMS
+ *             one BENCH line per benchmark, key=value fields like the
+ *             kernel's STAT lines, so builds can be compared with a script
+ * ***********************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <usloss.h>
+#include "phase1.h"
+#include "phase3_usermode.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define MAXBENCH	16
+#define BENCHNAME	64
+
+typedef struct bench {
+	char name[BENCHNAME];
+	int *samples;		// latency of each operation in microseconds
+	int count;
+	int size;
+	int begin;			// when the run started
+} bench;
+
+static bench benches[MAXBENCH];
+static int numBenches = 0;
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+static int compareInt(const void *a, const void *b);
+static int percentile(int *sorted, int count, int percent);
+/* ------------------------------------------------------------------------- */
+
+/*
+ * @return: currentTime(), through GetTimeofDay() in user mode where part 1
+ * cannot be called directly
+ */
+int benchTime(void) {
+	if (USLOSS_PsrGet() & USLOSS_PSR_CURRENT_MODE) return currentTime();
+	int now;
+	GetTimeofDay(&now);
+	return now;
+}
+
+/*
+ * @return: the iteration count, BENCH_ITERS overrides the given default
+ */
+int benchIters(int iters) {
+	char *str = getenv("BENCH_ITERS");
+	if (str != NULL && atoi(str) > 0) return atoi(str);
+	return iters;
+}
+
+/*
+ * Make room for iters samples, halts if there is no memory or no bench left
+ * @return: the id to pass to the other bench calls
+ */
+int benchOpen(char *name, int iters) {
+	if (numBenches == MAXBENCH) {
+		USLOSS_Console("ERROR: more than %d benchmarks\n", MAXBENCH);
+		USLOSS_Halt(1);
+	}
+	bench *b = &benches[numBenches];
+	b -> samples = malloc(iters * sizeof(int));
+	if (b -> samples == NULL) {
+		USLOSS_Console("ERROR: no memory for %d samples\n", iters);
+		USLOSS_Halt(1);
+	}
+	strncpy(b -> name, name, BENCHNAME - 1);
+	b -> size = iters;
+	b -> count = 0;
+	b -> begin = benchTime();
+	return numBenches++;
+}
+
+/*
+ * Restart the run's clock, for setup that should not count
+ */
+void benchBegin(int id) {
+	benches[id].begin = benchTime();
+}
+
+/*
+ * Add one operation's latency, safe to call from an interrupt handler
+ */
+void benchSample(int id, int value) {
+	bench *b = &benches[id];
+	if (b -> count < b -> size) b -> samples[b -> count++] = value;
+}
+
+/*
+ * Print the BENCH line: operations, wall time since the run started, 
+ * operations per second and exact latency percentiles
+ */
+void benchReport(int id) {
+	bench *b = &benches[id];
+	int elapsed = benchTime() - b -> begin;
+	qsort(b -> samples, b -> count, sizeof(int), compareInt);
+	long long opsPerSec = elapsed > 0 ? b -> count * 1000000LL / elapsed : 0;
+	long long total = 0;
+	for (int i = 0; i < b -> count; i++) total += b -> samples[i];
+	USLOSS_Console("BENCH name=%s ops=%d elapsed_us=%d ops_per_sec=%lld mean_us=%.2f p50_us=%d p90_us=%d p99_us=%d max_us=%d\n",
+					b -> name, b -> count, elapsed, opsPerSec, 
+					b -> count ? (double)total / b -> count : 0.0,
+					percentile(b -> samples, b -> count, 50),
+					percentile(b -> samples, b -> count, 90),
+					percentile(b -> samples, b -> count, 99),
+					b -> count ? b -> samples[b -> count - 1] : 0);
+}
+
+/* -------------------------------------------------------- Helper Functions */
+static int compareInt(const void *a, const void *b) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * @return: the nearest-rank percentile of sorted samples, 0 if there are none
+ */
+static int percentile(int *sorted, int count, int percent) {
+	if (count == 0) return 0;
+	int rank = (count * percent + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+/* ------------------------------------------------------------------------- */
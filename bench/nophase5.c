@@ -0,0 +1,12 @@
+/* ***********************************************
+ * FILE:       nophase5.c
+ * PURPOSE:    STAND-IN, PHASE 5 IS NOT LINKED INTO THE BENCHMARKS
+ *             they time parts 1-4 alone, so part 1's hooks into it do
+ *             nothing. smoke5 links part5.c instead
+ * ***********************************************/
+
+void phase5_init(void) {}
+void phase5_start_service_processes(void) {}
+void mmu_init_proc(int pid) {}
+void mmu_quit(int pid) {}
+void mmu_switch(int pid) {}
@@ -0,0 +1,6 @@
+/* ***********************************************
+ * FILE:       part1.h
+ * PURPOSE:    STAND-IN, part1.c and part2.c include this name
+ * ***********************************************/
+
+#include "phase1.h"
@@ -0,0 +1,6 @@
+/* ***********************************************
+ * FILE:       part2.h
+ * PURPOSE:    STAND-IN, part2.c includes this name
+ * ***********************************************/
+
+#include "phase2.h"
@@ -0,0 +1,56 @@
+/* ***********************************************
+ * FILE:       phase1.h
+ * PURPOSE:    STAND-IN FOR THE COURSE'S PHASE 1 HEADER
+ *             the sizes and entry points parts 1-4 expect, and the names
+ *             the course gives to functions this repository calls
+ *             something else
+ * ***********************************************/
+
+#ifndef _PHASE1_H
+#define _PHASE1_H
+
+#include <usloss.h>
+
+#define MAXPROC		50
+#define MAXNAME		50
+#define MAXARG		100
+
+// course name -> name in this repository
+#define fork1							fork
+#define dumpProcesses					dumpProc
+#define phase1_init						part1_init
+#define phase2_start_service_processes	part2_start_service_processes
+#define phase2_clockHandler				part2_clockHandler
+#define phase2_check_io					part2_check_io
+
+void part1_init(void);
+int fork(char *name, int (*func)(char *), char *arg, int stacksize, int priority);
+int join(int *status);
+void quit(int status);
+int zap(int pid);
+int isZapped(void);
+int getpid(void);
+void dumpProc(void);
+int blockMe(int block_status);
+int unblockProc(int pid);
+int readCurStartTime(void);
+void timeSlice(void);
+int readtime(void);
+int currentTime(void);
+void startProcesses(void);
+
+// called by part 1, provided by the later phases
+void part2_start_service_processes(void);
+void part2_clockHandler(void);
+int part2_check_io(void);
+void phase3_start_service_processes(void);
+void phase4_start_service_processes(void);
+void phase5_start_service_processes(void);
+void mmu_init_proc(int pid);
+void mmu_quit(int pid);
+void mmu_switch(int pid);
+
+// the program being run, in kernel mode at priority 5
+int testcase_main(void);
+
+#endif
@@ -0,0 +1,47 @@
+/* ***********************************************
+ * FILE:       phase2.h
+ * PURPOSE:    STAND-IN FOR THE COURSE'S PHASE 2 HEADER
+ * ***********************************************/
+
+#ifndef _PHASE2_H
+#define _PHASE2_H
+
+#include "phase1.h"
+
+#define MAXMBOX		2000
+#define MAXSLOTS	2500
+#define MAX_MESSAGE	150
+#define MAXSYSCALLS	50
+
+// course name -> name in this repository
+#define phase2_init		part2_init
+#define MboxCreate		CreateMbox
+#define MboxRelease		ReleaseMbox
+#define MboxSend		SendMbox
+#define MboxReceive		ReceiveMbox
+#define MboxCondSend	CondSendMbox
+#define MboxCondReceive	CondReceiveMbox
+#define waitDevice		deviceWait
+
+typedef struct systemArgs {
+	int number;
+	void *arg1;
+	void *arg2;
+	void *arg3;
+	void *arg4;
+	void *arg5;
+} systemArgs;
+
+extern void (*systemCallVec[])(systemArgs *args);
+
+void part2_init(void);
+int CreateMbox(int numSlots, int slotSize);
+int ReleaseMbox(int mbox_id);
+int SendMbox(int mbox_id, void *msg_ptr, int msg_size);
+int ReceiveMbox(int mbox_id, void *msg_ptr, int msg_max_size);
+int CondSendMbox(int mbox_id, void *msg_ptr, int msg_size);
+int CondReceiveMbox(int mbox_id, void *msg_ptr, int msg_max_size);
+int PollMbox(int *ids, int count, int *ready);
+int deviceWait(int type, int unit, int *status);
+
+#endif
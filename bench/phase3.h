@@ -0,0 +1,15 @@
+/* ***********************************************
+ * FILE:       phase3.h
+ * PURPOSE:    STAND-IN FOR THE COURSE'S PHASE 3 HEADER
+ * ***********************************************/
+
+#ifndef _PHASE3_H
+#define _PHASE3_H
+
+#include "phase2.h"
+
+#define MAXSEMS		200
+
+void phase3_init(void);
+
+#endif
@@ -0,0 +1,20 @@
+/* ***********************************************
+ * FILE:       phase3_usermode.h
+ * PURPOSE:    STAND-IN, PHASE 3 SYSCALLS FOR USER MODE, see usermode.c
+ * ***********************************************/
+
+#ifndef _PHASE3_USERMODE_H
+#define _PHASE3_USERMODE_H
+
+int Spawn(char *name, int (*func)(char *), char *arg, int stack_size, 
+			int priority, int *pid);
+int Wait(int *pid, int *status);
+void Terminate(int status);
+int SemCreate(int value, int *semaphore);
+int SemP(int semaphore);
+int SemV(int semaphore);
+void GetTimeofDay(int *tod);
+void CPUTime(int *cpu);
+void GetPID(int *pid);
+
+#endif
@@ -0,0 +1,15 @@
+/* ***********************************************
+ * FILE:       phase4.h
+ * PURPOSE:    STAND-IN FOR THE COURSE'S PHASE 4 HEADER
+ * ***********************************************/
+
+#ifndef _PHASE4_H
+#define _PHASE4_H
+
+#include "phase3.h"
+
+#define MAXLINE		80
+
+void phase4_init(void);
+
+#endif
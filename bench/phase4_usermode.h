@@ -0,0 +1,16 @@
+/* ***********************************************
+ * FILE:       phase4_usermode.h
+ * PURPOSE:    STAND-IN, PHASE 4 SYSCALLS FOR USER MODE, see usermode.c
+ * ***********************************************/
+
+#ifndef _PHASE4_USERMODE_H
+#define _PHASE4_USERMODE_H
+
+int Sleep(int seconds);
+int TermRead(char *buffer, int bufferSize, int unit, int *numCharsRead);
+int TermWrite(char *buffer, int bufferSize, int unit, int *numCharsWritten);
+int DiskSize(int unit, int *sector, int *track, int *disk);
+int DiskRead(void *buffer, int unit, int track, int first, int sectors, int *status);
+int DiskWrite(void *buffer, int unit, int track, int first, int sectors, int *status);
+
+#endif
@@ -0,0 +1,68 @@
+/* ***********************************************
+ * FILE:       smoke.c
+ * PURPOSE:    CHECK THE STAND-IN BOOTS PARTS 1-4
+ *             one pass over every driver and syscall family, then the
+ *             kernel's stats
+ * ***********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <usloss.h>
+#include "phase4.h"
+#include "phase3_usermode.h"
+#include "phase4_usermode.h"
+
+/* ------------------------------------------------------- Helper Functions */
+void dumpStats();
+int child(char *arg);
+/* ------------------------------------------------------------------------- */
+
+int testcase_main(void) {
+	int pid, status, sem;
+	char arg[16];
+	if (SemCreate(0, &sem) != 0) return 1;
+	// fork() copies the argument as a string
+	sprintf(arg, "%d", sem);
+	if (Spawn("child", child, arg, USLOSS_MIN_STACK, 3, &pid) != 0)
+		return 2;
+	if (SemP(sem) != 0) return 3;
+	if (Wait(&pid, &status) != 0 || status != 0) return 4;
+	dumpStats();
+	USLOSS_Console("smoke: ok\n");
+	return 0;
+}
+
+/*
+ * Round trip a block through both disks and a line through terminal 0, and
+ * two blocks across the end of a track
+ */
+int child(char *arg) {
+	int sem = atoi(arg);
+	char out[2 * USLOSS_DISK_SECTOR_SIZE], in[2 * USLOSS_DISK_SECTOR_SIZE];
+	int sector, track, disk, status, len;
+	for (int unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+		if (DiskSize(unit, &sector, &track, &disk) != 0 || disk <= 1) 
+			Terminate(10);
+		sprintf(out, "block on unit %d", unit);
+		DiskWrite(out, unit, disk - 1, track - 1, 1, &status);
+		if (status != USLOSS_DEV_READY) Terminate(11);
+		DiskRead(in, unit, disk - 1, track - 1, 1, &status);
+		if (status != USLOSS_DEV_READY || strcmp(in, out) != 0) Terminate(12);
+	}
+	// the second block goes to the start of the next track, not its own
+	sprintf(out, "end of track 0");
+	sprintf(out + sector, "start of track 1");
+	DiskWrite(out, 0, 0, track - 1, 2, &status);
+	if (status != USLOSS_DEV_READY) Terminate(14);
+	DiskRead(in, 0, 1, 0, 1, &status);
+	if (status != USLOSS_DEV_READY || strcmp(in, out + sector) != 0) Terminate(15);
+	if (DiskRead(in, 0, 0, track, 1, &status) != -1) Terminate(16);
+	if (DiskRead(in, 0, disk - 1, track - 1, 2, &status) != -1) Terminate(17);
+	char *line = "smoke: terminal 0\n";
+	if (TermWrite(line, strlen(line), 0, &len) != 0 || len != (int)strlen(line)) 
+		Terminate(13);
+	SemV(sem);
+	Terminate(0);
+	return 0;
+}
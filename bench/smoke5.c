@@ -0,0 +1,68 @@
+/* ***********************************************
+ * FILE:       smoke5.c
+ * PURPOSE:    CHECK THE STAND-IN BOOTS PARTS 1-5
+ *             more pages are written than there are frames, so some are
+ *             evicted to swap and faulted back in, then a child forked
+ *             with every page shared writes one and gets its own copy
+ * ***********************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include "phase5.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define PAGES		12		// part5.c's private pages, more than its 8 frames
+
+static char *region;
+static int pageSize;
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+void dumpStats();
+int vmStatsHelper(int pid, int *rss, int *major, int *minor, int *ref, int *dirty);
+int child(char *arg);
+/* ------------------------------------------------------------------------- */
+
+int testcase_main(void) {
+	int numPages, status;
+	char expect[16];
+	region = USLOSS_MmuRegion(&numPages);
+	pageSize = USLOSS_MmuPageSize();
+	if (region == NULL || numPages < PAGES) return 1;
+	// every page faults in zero filled, the later ones evict the earlier
+	for (int i = 0; i < PAGES; i++) {
+		if (region[i * pageSize] != 0) return 2;
+		sprintf(region + i * pageSize, "page %d", i);
+	}
+	// and the evicted ones come back from swap
+	for (int i = 0; i < PAGES; i++) {
+		sprintf(expect, "page %d", i);
+		if (strcmp(region + i * pageSize, expect) != 0) return 3;
+	}
+	int rss, major, minor, ref, dirty;
+	if (vmStatsHelper(getpid(), &rss, &major, &minor, &ref, &dirty) != 0 
+			|| major == 0) 
+		return 4;
+	// the child shares the last page, which was just read so it is in core
+	int pid = fork("child", child, "", USLOSS_MIN_STACK, 3);
+	if (pid < 0 || join(&status) != pid || status != 0) return 5;
+	sprintf(expect, "page %d", PAGES - 1);
+	if (strcmp(region + (PAGES - 1) * pageSize, expect) != 0) return 6;
+	dumpStats();
+	USLOSS_Console("smoke5: ok\n");
+	return 0;
+}
+
+/*
+ * Write a page shared with the parent, the parent's copy must not change
+ */
+int child(char *arg) {
+	char *page = region + (PAGES - 1) * pageSize;
+	char expect[16];
+	sprintf(expect, "page %d", PAGES - 1);
+	if (strcmp(page, expect) != 0) return 10;
+	strcpy(page, "child's copy");
+	if (strcmp(page, "child's copy") != 0) return 11;
+	return 0;
+}
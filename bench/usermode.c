@@ -0,0 +1,147 @@
+/* ***********************************************
+ * FILE:       usermode.c
+ * PURPOSE:    STAND-IN, THE USER-MODE SIDE OF THE PHASE 3 AND 4 SYSCALLS
+ *             each call packs systemArgs the way part3.c and part4.c
+ *             unpack them and traps with USLOSS_Syscall()
+ * ***********************************************/
+
+#include <usloss.h>
+#include <usyscall.h>
+#include "phase2.h"
+#include "phase3_usermode.h"
+#include "phase4_usermode.h"
+
+/* ------------------------------------------------------------- Phase 3 */
+int Spawn(char *name, int (*func)(char *), char *arg, int stack_size, 
+			int priority, int *pid) {
+	systemArgs args = { .number = SYS_SPAWN };
+	args.arg1 = func;
+	args.arg2 = arg;
+	args.arg3 = (void *)(long)stack_size;
+	args.arg4 = (void *)(long)priority;
+	args.arg5 = name;
+	USLOSS_Syscall(&args);
+	*pid = (long)args.arg1;
+	return (long)args.arg4;
+}
+
+int Wait(int *pid, int *status) {
+	systemArgs args = { .number = SYS_WAIT };
+	USLOSS_Syscall(&args);
+	*pid = (long)args.arg1;
+	*status = (long)args.arg2;
+	return (long)args.arg4;
+}
+
+void Terminate(int status) {
+	systemArgs args = { .number = SYS_TERMINATE };
+	args.arg1 = (void *)(long)status;
+	USLOSS_Syscall(&args);
+}
+
+int SemCreate(int value, int *semaphore) {
+	systemArgs args = { .number = SYS_SEMCREATE };
+	args.arg1 = (void *)(long)value;
+	USLOSS_Syscall(&args);
+	*semaphore = (long)args.arg1;
+	return (long)args.arg4;
+}
+
+int SemP(int semaphore) {
+	systemArgs args = { .number = SYS_SEMP };
+	args.arg1 = (void *)(long)semaphore;
+	USLOSS_Syscall(&args);
+	return (long)args.arg4;
+}
+
+int SemV(int semaphore) {
+	systemArgs args = { .number = SYS_SEMV };
+	args.arg1 = (void *)(long)semaphore;
+	USLOSS_Syscall(&args);
+	return (long)args.arg4;
+}
+
+void GetTimeofDay(int *tod) {
+	systemArgs args = { .number = SYS_GETTIMEOFDAY };
+	USLOSS_Syscall(&args);
+	*tod = (long)args.arg1;
+}
+
+void CPUTime(int *cpu) {
+	systemArgs args = { .number = SYS_GETPROCINFO };
+	USLOSS_Syscall(&args);
+	*cpu = (long)args.arg1;
+}
+
+void GetPID(int *pid) {
+	systemArgs args = { .number = SYS_GETPID };
+	USLOSS_Syscall(&args);
+	*pid = (long)args.arg1;
+}
+
+/* ------------------------------------------------------------- Phase 4 */
+int Sleep(int seconds) {
+	systemArgs args = { .number = SYS_SLEEP };
+	args.arg1 = (void *)(long)seconds;
+	USLOSS_Syscall(&args);
+	return (long)args.arg4;
+}
+
+int TermRead(char *buffer, int bufferSize, int unit, int *numCharsRead) {
+	systemArgs args = { .number = SYS_TERMREAD };
+	args.arg1 = buffer;
+	args.arg2 = (void *)(long)bufferSize;
+	args.arg3 = (void *)(long)unit;
+	USLOSS_Syscall(&args);
+	*numCharsRead = (long)args.arg2;
+	return (long)args.arg4;
+}
+
+int TermWrite(char *buffer, int bufferSize, int unit, int *numCharsWritten) {
+	systemArgs args = { .number = SYS_TERMWRITE };
+	args.arg1 = buffer;
+	args.arg2 = (void *)(long)bufferSize;
+	args.arg3 = (void *)(long)unit;
+	USLOSS_Syscall(&args);
+	*numCharsWritten = (long)args.arg2;
+	return (long)args.arg4;
+}
+
+int DiskSize(int unit, int *sector, int *track, int *disk) {
+	systemArgs args = { .number = SYS_DISKSIZE };
+	args.arg1 = (void *)(long)unit;
+	USLOSS_Syscall(&args);
+	*sector = (long)args.arg1;
+	*track = (long)args.arg2;
+	*disk = (long)args.arg3;
+	return (long)args.arg4;
+}
+
+/*
+ * @return: -1 for invalid arguments, 0 otherwise, *status is the device
+ * status of the request
+ */
+static int diskTransfer(int number, void *buffer, int unit, int track, 
+						int first, int sectors, int *status) {
+	systemArgs args = { .number = number };
+	args.arg1 = buffer;
+	args.arg2 = (void *)(long)sectors;
+	args.arg3 = (void *)(long)track;
+	args.arg4 = (void *)(long)first;
+	args.arg5 = (void *)(long)unit;
+	USLOSS_Syscall(&args);
+	*status = (long)args.arg1;
+	return (long)args.arg4;
+}
+
+int DiskRead(void *buffer, int unit, int track, int first, int sectors, 
+				int *status) {
+	return diskTransfer(SYS_DISKREAD, buffer, unit, track, first, sectors, 
+						status);
+}
+
+int DiskWrite(void *buffer, int unit, int track, int first, int sectors, 
+				int *status) {
+	return diskTransfer(SYS_DISKWRITE, buffer, unit, track, first, sectors, 
+						status);
+}
@@ -0,0 +1,679 @@
+/* ***********************************************
+ * FILE:       usloss.c
+ * PURPOSE:    HOST-NATIVE STAND-IN FOR THE USLOSS SIMULATOR
+ *             contexts are ucontext_t, time is the host's monotonic clock,
+ *             disks live in memory and terminals are files, so parts 1-5
+ *             can be linked and timed without the course library
+ *             The MMU maps frames of a memfd into the VM region and finds
+ *             out about accesses from SIGSEGV, a page is only opened up as
+ *             far as its frame's REF and DIRTY bits are already set
+ * ***********************************************/
+
+#define _GNU_SOURCE		// memfd_create()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <usloss.h>
+
+/* -------------------------------------------------------- Global Variables */
+#define CLOCKUS			20000	// clock interrupt period
+#define DISKTRACKS		32		// tracks per disk
+#define SEEKUS			10		// per track the head crosses
+#define SECTORUS		20		// per sector read or written
+#define CHARUS			50		// per char received or sent by a terminal
+#define NEVER			0x7fffffffffffffffLL
+#define MMUMAXFRAMES	(1 << 20)	// what the frame field of a PTE holds
+#define UNMAPPED		-1
+
+typedef struct Disk {
+	char *data;
+	int tracks;
+	int head;			// track the head is on
+	long long seekTracks;	// tracks crossed since boot
+	int busy;
+	int status;			// READY or ERROR once the request is done
+	long long due;		// the request completes at this time
+	USLOSS_DeviceRequest req;
+	int pending;		// an interrupt is waiting to be delivered
+} Disk;
+
+typedef struct Term {
+	FILE *in;			// term%d.in, NULL if there is none
+	FILE *out;			// term%d.out, opened on the first char sent
+	int recvInt;		// interrupts enabled by the control register
+	int xmitInt;
+	int recvStatus;		// BUSY while a received char is unread
+	int recvChar;
+	long long nextChar;	// the next char arrives at this time
+	int xmitBusy;
+	long long xmitDue;	// the char being sent is done at this time
+	long long xmitReady;	// announce an idle transmitter at this time
+	int pending;
+} Term;
+
+void (*USLOSS_IntVec[USLOSS_NUM_INTS])(int dev, void *arg);
+
+static unsigned int psr = USLOSS_PSR_CURRENT_MODE;
+static struct timespec bootTime;
+static long long clockUs = CLOCKUS;
+static long long seekUs = SEEKUS;
+static long long sectorUs = SECTORUS;
+static long long charUs = CHARUS;
+static long long nextTick;
+static int clockPending;
+static long long nextEvent;	// no device changes state before this time
+static Disk disks[USLOSS_DISK_UNITS];
+static Term terms[USLOSS_TERM_UNITS];
+static int mmuOn;
+static int mmuPages, mmuFrames, mmuPageSize;
+static char *mmuRegion;
+static int mmuFd;				// memfd holding every frame
+static USLOSS_PTE *mmuTable;	// the loaded page table, NULL for none
+static int *mmuAccess;			// REF and DIRTY bits of each frame
+static int *mmuFrame;			// frame mapped at each page, UNMAPPED if none
+static int *mmuProt;			// protection each page is mapped with
+static int mmuCause;
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+static long long now(void);
+static long long envValue(char *name, long long value);
+static void pollDevices(long long t);
+static int anyPending(void);
+static void deliverPending(void);
+static void interrupt(int type, int unit);
+static void checkInterrupts(void);
+static void diskComplete(Disk *disk);
+static int diskOutput(int unit, USLOSS_DeviceRequest *req);
+static int termOutput(int unit, int ctrl);
+static void flushTerminals(void);
+static void mmuMap(int page);
+static void mmuMapFrame(int frame);
+static void mmuFault(int sig, siginfo_t *info, void *context);
+
+// boot sequence, every phase's init in order and then the first process
+void part1_init(void);
+void part2_init(void);
+void phase3_init(void);
+void phase4_init(void);
+void phase5_init(void);
+void startProcesses(void);
+/* ------------------------------------------------------------------------- */
+
+/* -------------------------------------------------------------------- Boot */
+int main(int argc, char *argv[]) {
+	clock_gettime(CLOCK_MONOTONIC, &bootTime);
+	clockUs = envValue("USLOSS_CLOCK_US", clockUs);
+	seekUs = envValue("USLOSS_SEEK_US", seekUs);
+	sectorUs = envValue("USLOSS_SECTOR_US", sectorUs);
+	charUs = envValue("USLOSS_CHAR_US", charUs);
+	int tracks = envValue("USLOSS_DISK_TRACKS", DISKTRACKS);
+	for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
+		disks[i].tracks = tracks;
+		disks[i].data = calloc(tracks, USLOSS_DISK_TRACK_SIZE
+									* USLOSS_DISK_SECTOR_SIZE);
+		if (disks[i].data == NULL) {
+			fprintf(stderr, "ERROR: no memory for disk %d\n", i);
+			exit(1);
+		}
+	}
+	for (int i = 0; i < USLOSS_TERM_UNITS; i++) {
+		char name[16];
+		sprintf(name, "term%d.in", i);
+		terms[i].in = fopen(name, "r");
+	}
+	nextTick = clockUs;
+	nextEvent = 0;
+	// boot in kernel mode with interrupts off
+	psr = USLOSS_PSR_CURRENT_MODE;
+	part1_init();
+	part2_init();
+	phase3_init();
+	phase4_init();
+	phase5_init();
+	startProcesses();
+	USLOSS_Halt(0);
+	return 0;
+}
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------------------- Calls */
+void USLOSS_Console(char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	fflush(stdout);
+}
+
+void USLOSS_Trace(char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+void USLOSS_Halt(int status) {
+	fflush(stdout);
+	flushTerminals();
+	exit(status);
+}
+
+/*
+ * Interrupts that came due while they were off are delivered here
+ */
+unsigned int USLOSS_PsrGet(void) {
+	checkInterrupts();
+	return psr;
+}
+
+/*
+ * @return: USLOSS_ERR_INVALID_PSR for bits outside the PSR, halts if called
+ * from user mode
+ */
+int USLOSS_PsrSet(unsigned int value) {
+	if (value & ~USLOSS_PSR_MASK) return USLOSS_ERR_INVALID_PSR;
+	if (! (psr & USLOSS_PSR_CURRENT_MODE)) {
+		USLOSS_Console("ERROR: USLOSS_PsrSet() called in user mode\n");
+		USLOSS_Halt(1);
+	}
+	psr = value;
+	checkInterrupts();
+	return USLOSS_ERR_OK;
+}
+
+/*
+ * Clock: microseconds since boot. Disk: BUSY until the request is done,
+ * then READY or ERROR. Terminal: the status register, reading it consumes
+ * the received char
+ * @return: USLOSS_DEV_INVALID for a bad device or unit
+ */
+int USLOSS_DeviceInput(int dev, int unit, int *status) {
+	if (status == NULL) return USLOSS_DEV_INVALID;
+	long long t = now();
+	if (t >= nextEvent) pollDevices(t);
+	if (dev == USLOSS_CLOCK_DEV && unit == 0) {
+		*status = (int)t;
+	} else if (dev == USLOSS_DISK_DEV && unit >= 0
+				&& unit < USLOSS_DISK_UNITS) {
+		*status = disks[unit].busy ? USLOSS_DEV_BUSY : disks[unit].status;
+	} else if (dev == USLOSS_TERM_DEV && unit >= 0
+				&& unit < USLOSS_TERM_UNITS) {
+		Term *term = &terms[unit];
+		int xmit = term -> xmitBusy ? USLOSS_DEV_BUSY : USLOSS_DEV_READY;
+		*status = term -> recvStatus | (xmit << 2) | (term -> recvChar << 8);
+		term -> recvStatus = USLOSS_DEV_READY;
+	} else return USLOSS_DEV_INVALID;
+	return USLOSS_DEV_OK;
+}
+
+/*
+ * Disk: start a USLOSS_DeviceRequest. Terminal: write the control register
+ * @return: USLOSS_DEV_INVALID for a bad device, unit or request,
+ * USLOSS_DEV_BUSY if the device has not finished the last one
+ */
+int USLOSS_DeviceOutput(int dev, int unit, void *arg) {
+	int result = USLOSS_DEV_INVALID;
+	if (dev == USLOSS_DISK_DEV && unit >= 0 && unit < USLOSS_DISK_UNITS)
+		result = diskOutput(unit, arg);
+	else if (dev == USLOSS_TERM_DEV && unit >= 0 && unit < USLOSS_TERM_UNITS)
+		result = termOutput(unit, (int)(long)arg);
+	// the device changed, look at it again on the next check
+	nextEvent = 0;
+	return result;
+}
+
+/*
+ * Sleep until the next device event and deliver its interrupt, interrupts
+ * are delivered even if the caller has them off
+ */
+void USLOSS_WaitInt(void) {
+	while (1) {
+		long long t = now();
+		pollDevices(t);
+		if (anyPending()) break;
+		struct timespec until = bootTime;
+		long long ns = until.tv_nsec + (nextEvent % 1000000) * 1000;
+		until.tv_sec += nextEvent / 1000000 + ns / 1000000000;
+		until.tv_nsec = ns % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+	}
+	unsigned int saved = psr;
+	psr |= USLOSS_PSR_CURRENT_INT;
+	deliverPending();
+	psr = saved;
+}
+
+/*
+ * Trap into the kernel, like an interrupt with arg as the handler's argument
+ */
+void USLOSS_Syscall(void *arg) {
+	if (USLOSS_IntVec[USLOSS_SYSCALL_INT] == NULL) {
+		USLOSS_Console("ERROR: USLOSS_Syscall() with no handler installed\n");
+		USLOSS_Halt(1);
+	}
+	unsigned int saved = psr;
+	psr = USLOSS_PSR_CURRENT_MODE | ((saved & 0x3) << 2);
+	USLOSS_IntVec[USLOSS_SYSCALL_INT](USLOSS_SYSCALL_INT, arg);
+	psr = saved;
+	checkInterrupts();
+}
+
+void USLOSS_ContextInit(USLOSS_Context *context, void *stack, int stackSize,
+						USLOSS_PTE *pageTable, void (*func)(void)) {
+	getcontext(&context -> context);
+	context -> context.uc_stack.ss_sp = stack;
+	context -> context.uc_stack.ss_size = stackSize;
+	context -> context.uc_link = NULL;
+	makecontext(&context -> context, func, 0);
+	context -> func = func;
+	context -> pageTable = pageTable;
+}
+
+/*
+ * old is NULL when the running context is never resumed
+ */
+void USLOSS_ContextSwitch(USLOSS_Context *old, USLOSS_Context *new) {
+	if (old == NULL) setcontext(&new -> context);
+	else swapcontext(&old -> context, &new -> context);
+}
+
+/*
+ * Set up the VM region with numPages pages and numFrames frames, none of
+ * them mapped, numMaps is ignored
+ * @return: USLOSS_MMU_ERR_ON if called twice, USLOSS_MMU_ERR_MODE for any
+ * mode but USLOSS_MMU_MODE_PAGETABLE, USLOSS_MMU_ERR_FRAME for too many
+ * frames
+ */
+int USLOSS_MmuInit(int numMaps, int numPages, int numFrames, int mode) {
+	if (mmuOn) return USLOSS_MMU_ERR_ON;
+	if (mode != USLOSS_MMU_MODE_PAGETABLE) return USLOSS_MMU_ERR_MODE;
+	if (numFrames <= 0 || numFrames > MMUMAXFRAMES) return USLOSS_MMU_ERR_FRAME;
+	mmuPageSize = sysconf(_SC_PAGESIZE);
+	mmuPages = numPages;
+	mmuFrames = numFrames;
+	mmuFd = memfd_create("usloss-frames", 0);
+	mmuRegion = mmap(NULL, (long)numPages * mmuPageSize, PROT_NONE,
+						MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	mmuAccess = calloc(numFrames, sizeof(int));
+	mmuFrame = malloc(numPages * sizeof(int));
+	mmuProt = calloc(numPages, sizeof(int));
+	if (mmuFd == -1 || ftruncate(mmuFd, (long)numFrames * mmuPageSize) != 0
+			|| mmuRegion == MAP_FAILED || mmuAccess == NULL || mmuFrame == NULL
+			|| mmuProt == NULL) {
+		fprintf(stderr, "ERROR: no memory for the MMU\n");
+		exit(1);
+	}
+	for (int i = 0; i < numPages; i++) mmuFrame[i] = UNMAPPED;
+	// the handler blocks in the kernel and other processes fault meanwhile
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = mmuFault;
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigaction(SIGSEGV, &action, NULL);
+	mmuTable = NULL;
+	mmuOn = 1;
+	return USLOSS_MMU_OK;
+}
+
+/*
+ * @return: the start of the VM region, NULL if the MMU is off
+ */
+void *USLOSS_MmuRegion(int *numPages) {
+	if (! mmuOn) return NULL;
+	if (numPages != NULL) *numPages = mmuPages;
+	return mmuRegion;
+}
+
+/*
+ * @return: the host's page size, 0 if the MMU is off
+ */
+int USLOSS_MmuPageSize(void) {
+	return mmuOn ? mmuPageSize : 0;
+}
+
+/*
+ * Load a page table of USLOSS_MmuRegion() entries, NULL unmaps every page
+ * The table is read again on every fault, and the region is brought in line
+ * with it here, so call this after changing the loaded table
+ */
+int USLOSS_MmuSetPageTable(USLOSS_PTE *pageTable) {
+	if (! mmuOn) return USLOSS_MMU_ERR_OFF;
+	mmuTable = pageTable;
+	for (int i = 0; i < mmuPages; i++) mmuMap(i);
+	return USLOSS_MMU_OK;
+}
+
+int USLOSS_MmuGetAccess(int frame, int *access) {
+	if (! mmuOn) return USLOSS_MMU_ERR_OFF;
+	if (frame < 0 || frame >= mmuFrames || access == NULL) 
+		return USLOSS_MMU_ERR_FRAME;
+	*access = mmuAccess[frame];
+	return USLOSS_MMU_OK;
+}
+
+/*
+ * Clearing a bit closes the frame's pages up again, so the next access
+ * sets it
+ */
+int USLOSS_MmuSetAccess(int frame, int access) {
+	if (! mmuOn) return USLOSS_MMU_ERR_OFF;
+	if (frame < 0 || frame >= mmuFrames) return USLOSS_MMU_ERR_FRAME;
+	mmuAccess[frame] = access & (USLOSS_MMU_REF | USLOSS_MMU_DIRTY);
+	mmuMapFrame(frame);
+	return USLOSS_MMU_OK;
+}
+
+/*
+ * @return: USLOSS_MMU_FAULT or USLOSS_MMU_ACCESS, why the last MMU
+ * interrupt was raised
+ */
+int USLOSS_MmuGetCause(void) {
+	return mmuCause;
+}
+
+/*
+ * Not in USLOSS, lets the benchmarks see what the device did
+ * @return: tracks the head of the disk crossed since boot, -1 for a bad unit
+ */
+long long standinSeekTracks(int unit) {
+	if (unit < 0 || unit >= USLOSS_DISK_UNITS) return -1;
+	return disks[unit].seekTracks;
+}
+/* ------------------------------------------------------------------------- */
+
+/* -------------------------------------------------------- Helper Functions */
+
+/*
+ * @return: microseconds since boot
+ */
+static long long now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - bootTime.tv_sec) * 1000000LL
+			+ (t.tv_nsec - bootTime.tv_nsec) / 1000;
+}
+
+/*
+ * @return: the environment variable as a number, value if it is not set
+ */
+static long long envValue(char *name, long long value) {
+	char *str = getenv(name);
+	if (str == NULL || atoll(str) <= 0) return value;
+	return atoll(str);
+}
+
+/*
+ * Bring every device up to time t, mark the interrupts that came due and
+ * find when the next one can
+ */
+static void pollDevices(long long t) {
+	long long next = NEVER;
+	// ticks missed while interrupts were off coalesce into one
+	if (t >= nextTick) {
+		clockPending = 1;
+		nextTick += clockUs;
+		if (nextTick <= t) nextTick = t + clockUs;
+	}
+	next = nextTick;
+	for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
+		Disk *disk = &disks[i];
+		if (disk -> busy && t >= disk -> due) diskComplete(disk);
+		if (disk -> busy && disk -> due < next) next = disk -> due;
+	}
+	for (int i = 0; i < USLOSS_TERM_UNITS; i++) {
+		Term *term = &terms[i];
+		// input only flows while the driver listens, so none is lost at boot
+		if (term -> recvInt && term -> in != NULL && t >= term -> nextChar
+				&& term -> recvStatus != USLOSS_DEV_BUSY) {
+			int c = fgetc(term -> in);
+			if (c == EOF) {
+				fclose(term -> in);
+				term -> in = NULL;
+			} else {
+				term -> recvStatus = USLOSS_DEV_BUSY;
+				term -> recvChar = c & 0xff;
+				term -> nextChar = t + charUs;
+				term -> pending = 1;
+			}
+		}
+		if (term -> xmitBusy && t >= term -> xmitDue) {
+			term -> xmitBusy = 0;
+			term -> xmitReady = t + charUs;
+			if (term -> xmitInt) term -> pending = 1;
+		}
+		// an idle transmitter keeps asking for chars while it may interrupt
+		if (term -> xmitInt && ! term -> xmitBusy && t >= term -> xmitReady) {
+			term -> xmitReady = t + charUs;
+			term -> pending = 1;
+		}
+		if (term -> recvInt && term -> in != NULL && term -> nextChar < next)
+			next = term -> nextChar;
+		if (term -> xmitBusy && term -> xmitDue < next)
+			next = term -> xmitDue;
+		if (term -> xmitInt && ! term -> xmitBusy && term -> xmitReady < next)
+			next = term -> xmitReady;
+	}
+	nextEvent = next;
+}
+
+/*
+ * @return: 1 if an interrupt is waiting to be delivered, 0 otherwise
+ */
+static int anyPending(void) {
+	if (clockPending) return 1;
+	for (int i = 0; i < USLOSS_DISK_UNITS; i++)
+		if (disks[i].pending) return 1;
+	for (int i = 0; i < USLOSS_TERM_UNITS; i++)
+		if (terms[i].pending) return 1;
+	return 0;
+}
+
+/*
+ * Deliver waiting interrupts for as long as they stay enabled, a handler
+ * can switch away and come back with them off
+ */
+static void deliverPending(void) {
+	if (clockPending && (psr & USLOSS_PSR_CURRENT_INT)) {
+		clockPending = 0;
+		interrupt(USLOSS_CLOCK_INT, 0);
+	}
+	for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
+		if (disks[i].pending && (psr & USLOSS_PSR_CURRENT_INT)) {
+			disks[i].pending = 0;
+			interrupt(USLOSS_DISK_INT, i);
+		}
+	}
+	for (int i = 0; i < USLOSS_TERM_UNITS; i++) {
+		if (terms[i].pending && (psr & USLOSS_PSR_CURRENT_INT)) {
+			terms[i].pending = 0;
+			interrupt(USLOSS_TERM_INT, i);
+		}
+	}
+}
+
+/*
+ * Run a handler in kernel mode with interrupts off, the PSR it interrupted
+ * comes back when it returns
+ */
+static void interrupt(int type, int unit) {
+	if (USLOSS_IntVec[type] == NULL) return;
+	unsigned int saved = psr;
+	psr = USLOSS_PSR_CURRENT_MODE | ((saved & 0x3) << 2);
+	USLOSS_IntVec[type](type, (void *)(long)unit);
+	psr = saved;
+}
+
+static void checkInterrupts(void) {
+	if (! (psr & USLOSS_PSR_CURRENT_INT)) return;
+	long long t = now();
+	if (t >= nextEvent) pollDevices(t);
+	if (anyPending()) deliverPending();
+}
+
+/*
+ * Apply the request, data moves when the disk says it is done
+ */
+static void diskComplete(Disk *disk) {
+	USLOSS_DeviceRequest *req = &disk -> req;
+	int trackBytes = USLOSS_DISK_TRACK_SIZE * USLOSS_DISK_SECTOR_SIZE;
+	char *sector = disk -> data + disk -> head * trackBytes
+					+ (int)(long)req -> reg1 * USLOSS_DISK_SECTOR_SIZE;
+	disk -> busy = 0;
+	disk -> pending = 1;
+	if (disk -> status == USLOSS_DEV_ERROR) return;
+	if (req -> opr == USLOSS_DISK_READ)
+		memcpy(req -> reg2, sector, USLOSS_DISK_SECTOR_SIZE);
+	else if (req -> opr == USLOSS_DISK_WRITE)
+		memcpy(sector, req -> reg2, USLOSS_DISK_SECTOR_SIZE);
+	else if (req -> opr == USLOSS_DISK_TRACKS)
+		*(int *)req -> reg1 = disk -> tracks;
+}
+
+/*
+ * A seek costs SEEKUS per track crossed, a read or write SECTORUS, a request
+ * the disk cannot do fails with USLOSS_DEV_ERROR when it completes
+ */
+static int diskOutput(int unit, USLOSS_DeviceRequest *req) {
+	Disk *disk = &disks[unit];
+	if (req == NULL) return USLOSS_DEV_INVALID;
+	if (disk -> busy) return USLOSS_DEV_BUSY;
+	long long cost = sectorUs;
+	disk -> req = *req;
+	disk -> status = USLOSS_DEV_READY;
+	if (req -> opr == USLOSS_DISK_SEEK) {
+		int track = (int)(long)req -> reg1;
+		if (track < 0 || track >= disk -> tracks) {
+			disk -> status = USLOSS_DEV_ERROR;
+		} else {
+			cost = seekUs * (1 + abs(track - disk -> head));
+			disk -> seekTracks += abs(track - disk -> head);
+			disk -> head = track;
+		}
+	} else if (req -> opr == USLOSS_DISK_READ
+				|| req -> opr == USLOSS_DISK_WRITE) {
+		int sector = (int)(long)req -> reg1;
+		if (sector < 0 || sector >= USLOSS_DISK_TRACK_SIZE
+				|| req -> reg2 == NULL)
+			disk -> status = USLOSS_DEV_ERROR;
+	} else if (req -> opr == USLOSS_DISK_TRACKS) {
+		if (req -> reg1 == NULL) disk -> status = USLOSS_DEV_ERROR;
+	} else return USLOSS_DEV_INVALID;
+	disk -> busy = 1;
+	disk -> due = now() + cost;
+	return USLOSS_DEV_OK;
+}
+
+/*
+ * Take the interrupt enables from the control register and send its char
+ * if asked to
+ */
+static int termOutput(int unit, int ctrl) {
+	Term *term = &terms[unit];
+	int xmitInt = (ctrl & 0x4) != 0;
+	// turning transmit interrupts on announces an idle transmitter at once
+	if (xmitInt && ! term -> xmitInt) term -> xmitReady = 0;
+	term -> xmitInt = xmitInt;
+	term -> recvInt = (ctrl & 0x2) != 0;
+	if (! (ctrl & 0x1)) return USLOSS_DEV_OK;
+	if (term -> xmitBusy) return USLOSS_DEV_BUSY;
+	if (term -> out == NULL) {
+		char name[16];
+		sprintf(name, "term%d.out", unit);
+		term -> out = fopen(name, "w");
+	}
+	if (term -> out != NULL) fputc((ctrl >> 8) & 0xff, term -> out);
+	term -> xmitBusy = 1;
+	term -> xmitDue = now() + charUs;
+	return USLOSS_DEV_OK;
+}
+
+static void flushTerminals(void) {
+	for (int i = 0; i < USLOSS_TERM_UNITS; i++)
+		if (terms[i].out != NULL) fflush(terms[i].out);
+}
+
+/*
+ * Map a page of the region the way the loaded page table says, readable
+ * only once its frame is referenced and writable only once it is dirty
+ */
+static void mmuMap(int page) {
+	char *addr = mmuRegion + (long)page * mmuPageSize;
+	USLOSS_PTE *pte = mmuTable == NULL ? NULL : &mmuTable[page];
+	if (pte == NULL || ! pte -> incore || pte -> frame >= mmuFrames) {
+		if (mmuFrame[page] == UNMAPPED) return;
+		mmap(addr, mmuPageSize, PROT_NONE, 
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+		mmuFrame[page] = UNMAPPED;
+		mmuProt[page] = PROT_NONE;
+		return;
+	}
+	int access = mmuAccess[pte -> frame];
+	int prot = PROT_NONE;
+	if (pte -> read && (access & USLOSS_MMU_REF)) {
+		prot = PROT_READ;
+		if (pte -> write && (access & USLOSS_MMU_DIRTY)) prot |= PROT_WRITE;
+	}
+	if (mmuFrame[page] == pte -> frame && mmuProt[page] == prot) return;
+	if (mmuFrame[page] == pte -> frame) mprotect(addr, mmuPageSize, prot);
+	else {
+		mmap(addr, mmuPageSize, prot, MAP_SHARED | MAP_FIXED, mmuFd,
+				(off_t)pte -> frame * mmuPageSize);
+	}
+	mmuFrame[page] = pte -> frame;
+	mmuProt[page] = prot;
+}
+
+/*
+ * Map again every page of the loaded table that is on the frame
+ */
+static void mmuMapFrame(int frame) {
+	if (mmuTable == NULL) return;
+	for (int i = 0; i < mmuPages; i++)
+		if (mmuTable[i].incore && mmuTable[i].frame == frame) mmuMap(i);
+}
+
+/*
+ * SIGSEGV: an access the page table allows sets REF, or DIRTY if the page
+ * was readable already, since only a write faults there. Anything else is
+ * an MMU interrupt with the offset in the region as its argument. Either
+ * way the instruction runs again once the page is mapped as it is now
+ */
+static void mmuFault(int sig, siginfo_t *info, void *context) {
+	char *addr = info -> si_addr;
+	if (addr < mmuRegion || addr >= mmuRegion + (long)mmuPages * mmuPageSize) {
+		// not ours, crash at the same instruction
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+	int offset = addr - mmuRegion;
+	int page = offset / mmuPageSize;
+	USLOSS_PTE *pte = mmuTable == NULL ? NULL : &mmuTable[page];
+	int cause = 0;
+	if (pte == NULL || ! pte -> incore) cause = USLOSS_MMU_FAULT;
+	else if (mmuProt[page] == PROT_NONE) {
+		if (! pte -> read) cause = USLOSS_MMU_ACCESS;
+		else mmuAccess[pte -> frame] |= USLOSS_MMU_REF;
+	} else {
+		if (! pte -> write) cause = USLOSS_MMU_ACCESS;
+		else mmuAccess[pte -> frame] |= USLOSS_MMU_DIRTY;
+	}
+	if (cause != 0) {
+		if (USLOSS_IntVec[USLOSS_MMU_INT] == NULL) {
+			USLOSS_Console("ERROR: MMU fault at offset %d with no handler installed\n",
+							offset);
+			USLOSS_Halt(1);
+		}
+		mmuCause = cause;
+		interrupt(USLOSS_MMU_INT, offset);
+	}
+	// the handler may have loaded another table or changed this one
+	if (mmuTable != NULL && mmuTable[page].incore) mmuMapFrame(mmuTable[page].frame);
+	else mmuMap(page);
+}
+/* ------------------------------------------------------------------------- */
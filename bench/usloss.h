@@ -0,0 +1,129 @@
+/* ***********************************************
+ * FILE:       usloss.h
+ * PURPOSE:    HOST-NATIVE STAND-IN FOR THE USLOSS SIMULATOR
+ *             only the part of the API parts 1-5 use, see usloss.c
+ * ***********************************************/
+
+#ifndef _USLOSS_H
+#define _USLOSS_H
+
+#include <ucontext.h>
+
+/* ------------------------------------------------------------------- Stack */
+#define USLOSS_MIN_STACK	80000
+
+/* --------------------------------------------------------------------- PSR */
+#define USLOSS_PSR_CURRENT_MODE	0x1	// 1 is kernel mode
+#define USLOSS_PSR_CURRENT_INT	0x2	// 1 is interrupts enabled
+#define USLOSS_PSR_PREV_MODE	0x4	// saved on an interrupt or syscall
+#define USLOSS_PSR_PREV_INT		0x8
+#define USLOSS_PSR_MASK			0xf
+#define USLOSS_ERR_OK			0
+#define USLOSS_ERR_INVALID_PSR	1
+
+/* -------------------------------------------------------------- Interrupts */
+#define USLOSS_CLOCK_INT	0
+#define USLOSS_ALARM_INT	1
+#define USLOSS_TERM_INT		2
+#define USLOSS_SYSCALL_INT	3
+#define USLOSS_DISK_INT		4
+#define USLOSS_MMU_INT		5
+#define USLOSS_ILLEGAL_INT	6
+#define USLOSS_NUM_INTS		7
+
+/* ----------------------------------------------------------------- Devices */
+#define USLOSS_CLOCK_DEV	USLOSS_CLOCK_INT
+#define USLOSS_TERM_DEV		USLOSS_TERM_INT
+#define USLOSS_DISK_DEV		USLOSS_DISK_INT
+#define USLOSS_CLOCK_UNITS	1
+#define USLOSS_TERM_UNITS	4
+#define USLOSS_DISK_UNITS	2
+
+// returned by USLOSS_DeviceInput() and USLOSS_DeviceOutput()
+#define USLOSS_DEV_OK		0
+#define USLOSS_DEV_INVALID	1
+// device status
+#define USLOSS_DEV_READY	0
+#define USLOSS_DEV_BUSY		1
+#define USLOSS_DEV_ERROR	2
+
+// disk geometry and operations
+#define USLOSS_DISK_SECTOR_SIZE	512
+#define USLOSS_DISK_TRACK_SIZE	16
+#define USLOSS_DISK_READ	0
+#define USLOSS_DISK_WRITE	1
+#define USLOSS_DISK_SEEK	2
+#define USLOSS_DISK_TRACKS	3
+
+// terminal status register
+#define USLOSS_TERM_STAT_CHAR(status)	(((status) >> 8) & 0xff)
+#define USLOSS_TERM_STAT_XMIT(status)	(((status) >> 2) & 0x3)
+#define USLOSS_TERM_STAT_RECV(status)	((status) & 0x3)
+// terminal control register
+#define USLOSS_TERM_CTRL_CHAR(ctrl, ch)	((ctrl) | (((ch) & 0xff) << 8))
+#define USLOSS_TERM_CTRL_XMIT_INT(ctrl)	((ctrl) | 0x4)
+#define USLOSS_TERM_CTRL_RECV_INT(ctrl)	((ctrl) | 0x2)
+#define USLOSS_TERM_CTRL_XMIT_CHAR(ctrl)	((ctrl) | 0x1)
+
+/* --------------------------------------------------------------------- MMU */
+#define USLOSS_MMU_MODE_PAGETABLE	1	// the only mode the stand-in has
+// returned by the USLOSS_Mmu*() calls
+#define USLOSS_MMU_OK			0
+#define USLOSS_MMU_ERR_OFF		1	// USLOSS_MmuInit() was not called
+#define USLOSS_MMU_ERR_ON		2	// USLOSS_MmuInit() was called already
+#define USLOSS_MMU_ERR_FRAME	3
+#define USLOSS_MMU_ERR_MODE		4
+// USLOSS_MmuGetCause()
+#define USLOSS_MMU_FAULT		1	// the page is not in core
+#define USLOSS_MMU_ACCESS		2	// the PTE does not allow the access
+// frame access bits
+#define USLOSS_MMU_REF			0x1
+#define USLOSS_MMU_DIRTY		0x2
+
+/* -------------------------------------------------------------- Structures */
+typedef struct USLOSS_PTE {
+	unsigned int incore:1;
+	unsigned int read:1;
+	unsigned int write:1;
+	unsigned int frame:20;
+} USLOSS_PTE;
+
+typedef struct USLOSS_Context {
+	ucontext_t context;
+	void (*func)(void);
+	USLOSS_PTE *pageTable;
+} USLOSS_Context;
+
+typedef struct USLOSS_DeviceRequest {
+	int opr;
+	void *reg1;
+	void *reg2;
+} USLOSS_DeviceRequest;
+
+/* ------------------------------------------------------------------- Calls */
+extern void (*USLOSS_IntVec[USLOSS_NUM_INTS])(int dev, void *arg);
+
+void USLOSS_Console(char *fmt, ...);
+void USLOSS_Trace(char *fmt, ...);
+void USLOSS_Halt(int status);
+unsigned int USLOSS_PsrGet(void);
+int USLOSS_PsrSet(unsigned int psr);
+int USLOSS_DeviceInput(int dev, int unit, int *status);
+int USLOSS_DeviceOutput(int dev, int unit, void *arg);
+void USLOSS_WaitInt(void);
+void USLOSS_Syscall(void *arg);
+void USLOSS_ContextInit(USLOSS_Context *context, void *stack, int stackSize,
+						USLOSS_PTE *pageTable, void (*func)(void));
+void USLOSS_ContextSwitch(USLOSS_Context *old, USLOSS_Context *new);
+int USLOSS_MmuInit(int numMaps, int numPages, int numFrames, int mode);
+void *USLOSS_MmuRegion(int *numPages);
+int USLOSS_MmuPageSize(void);
+int USLOSS_MmuSetPageTable(USLOSS_PTE *pageTable);
+int USLOSS_MmuGetAccess(int frame, int *access);
+int USLOSS_MmuSetAccess(int frame, int access);
+int USLOSS_MmuGetCause(void);
+
+// stand-in only
+long long standinSeekTracks(int unit);
+
+#endif
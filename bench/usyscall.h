@@ -0,0 +1,27 @@
+/* ***********************************************
+ * FILE:       usyscall.h
+ * PURPOSE:    STAND-IN, SYSCALL NUMBERS
+ *             the extra syscalls of parts 2-5 count down from MAXSYSCALLS
+ * ***********************************************/
+
+#ifndef _USYSCALL_H
+#define _USYSCALL_H
+
+#define SYS_TERMREAD		1
+#define SYS_TERMWRITE		2
+#define SYS_SPAWN			3
+#define SYS_WAIT			4
+#define SYS_TERMINATE		5
+#define SYS_SLEEP			6
+#define SYS_DISKREAD		7
+#define SYS_DISKWRITE		8
+#define SYS_DISKSIZE		9
+#define SYS_SEMCREATE		10
+#define SYS_SEMP			11
+#define SYS_SEMV			12
+#define SYS_SEMFREE			13
+#define SYS_GETTIMEOFDAY	14
+#define SYS_GETPROCINFO		15
+#define SYS_GETPID			16
+
+#endif
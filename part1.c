@@ -10,6 +10,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <usloss.h>
+#ifdef STACKGUARD
+#include <sys/mman.h>
+#endif
 #include "part1.h"
 
 /* -------------------------------------------------------- Global Variables */
@@ -21,6 +24,17 @@
 #define DEAD			4
 #define CODEJOIN		20
 #define CODEZAP			21
+#define FIRSTFREESLOT	4	// slot 1-3 are init, sentinel and testcase_main
+#ifndef PROCTABLEMAX
+#define PROCTABLEMAX	1024	// most slots the table grows to, a multiple of PROCCHUNK
+#endif
+#define PROCCHUNK		16	// the table grows by this many slots at a time
+#define PROCCHUNKS		(PROCTABLEMAX / PROCCHUNK)
+#define MAXSHADOWS		8	// per-process tables the other phases keep here
+#define STACKCLASSES	6	// pools for USLOSS_MIN_STACK << 0 .. 4, then any size
+#define STACKGUARDSIZE	4096	// unmapped bytes below each stack with STACKGUARD
+#define MAXSTATS		64	// the phases register 40 between them
+#define STATBUCKETS		24	// bucket i holds values below 2^i, bucket 0 is 0
 /* ------------------------------------------------------------------------- */
 
 /* ------------------------------------------------------- Helper Functions */
@@ -39,6 +53,35 @@ void newProcess(int slot, char *name, int PID, int priority,
 					int (*func)(char *), char *arg,
 					int stacksize, int parentSlot);
 void deleteProcess(int slot);
+void releaseSlot(int slot);
+int allocateSlot();
+struct PTE *procEntry(int slot);
+struct PTECold *coldEntry(int slot);
+int growTable();
+int procSlot(int pid);
+int procTableSize();
+int procShadowRegister(int size);
+void *procShadow(int id, int pid);
+void *allocateStack(int stacksize, int *stackClass, int *stackBytes);
+void releaseStack(void *stack, int stackClass, int stackBytes);
+int waitSuccessor(int slot);
+void checkWaitCycle(int pid);
+void printWaitEdge(int slot, int now);
+void dumpWaitGraph();
+void registerWaitLookups(int (*mbox)(int), int (*sem)(int));
+int noWaitLookup(int pid);
+void registerForkHook(void (*hook)(int, int));
+void noForkHook(int parent, int child);
+void registerProcStatsHook(int (*hook)(int, int *, int *, int *, int *, int *));
+int noProcStats(int pid, int *rss, int *major, int *minor, int *ref, int *dirty);
+int statRegister(char *name);
+void statRecord(int id, int value);
+int statStart();
+void statLatency(int id, int start);
+int statPercentile(int id, int percent);
+void dumpStats();
+struct queue *newQueueNode(int pid);
+void freeQueueNode(struct queue *node);
 void launcher();
 
 static void clockHandler(int dev,void *arg)
@@ -59,45 +102,121 @@ typedef struct queue{
 	struct queue *next;
 } queue;
 
+// The fields the dispatcher and the blocking calls touch all the time,
+// kept small so the whole table stays in a few cache lines
 typedef struct PTE{
-	char name[MAXNAME];
+	// read or written on every context switch, keep these first
 	int PID;
+	int state;
 	int priority;
-	char arg[MAXARG];
-	int(*func)(char *);
-	int(*testCaseMain)(void);	/*	for testcase_main only	*/
-	int stacksize;
-	USLOSS_Context context;
+	int runnableStatus;
+	int currTimeSliceStart;
+	int CPUTime;
+	int blockedSince;	// when the current wait-for edge was created, -1 if untimed
+	// family, join and zap
 	struct PTE *parent;
 	struct PTE *firstChild;
 	struct PTE *lastChild; // TO MATCH TEST CASES
 	struct PTE *olderSibling;
 	struct PTE *youngerSibling;
 	int numChildren;
-	int state;
-	int runnableStatus;
 	int quitStatus;
 	int isZapped; /* 0 if not, 1 otherwise */
 	queue *zappers;
 	int numZapped;
-	int CPUTime;
-	int currTimeSliceStart;
+	int zapTarget;	// PID this process is blocked zapping
 	int read; // whether this process is dead and read by another process or not
 } PTE;
+
+// The fields only needed to start a process or switch to it, stored out of
+// line in chunks allocated the first time one of their slots is used
+typedef struct PTECold{
+	char name[MAXNAME];
+	char arg[MAXARG];
+	int(*func)(char *);
+	int(*testCaseMain)(void);	/*	for testcase_main only	*/
+	int stacksize;
+	void *stack;	// from allocateStack(), given back when the slot is freed
+	int stackClass;
+	int stackBytes;	// size of the stack as allocated, at least stacksize
+	USLOSS_Context context;
+} PTECold;
+
+// A pooled stack, the header lives in the lowest bytes of the stack itself
+// and is only valid while the stack is in the pool
+typedef struct freeStack{
+	int size;
+	struct freeStack *next;
+} freeStack;
+
+// One measured quantity, values are kept in a log2 histogram so percentiles
+// cost no memory per sample
+typedef struct kernelStat{
+	char name[MAXNAME];
+	int count;
+	long total;
+	int max;
+	int buckets[STATBUCKETS];
+} kernelStat;
 /* ------------------------------------------------------------------------- */
 
 /* --------------------------------------------------------------- Variables */
 // The PID of the currently running process
 int currProcess;
-// All processes in this array
-struct PTE procTable[MAXPROC];
-// Help assign new PID to new process
-int currPID;
+// All processes in this table, slot i is procChunks[i / PROCCHUNK][i % PROCCHUNK]
+// It starts with one chunk and grows by one whenever fork() finds no free
+// slot, up to PROCTABLEMAX. Chunks are never moved or freed, so PTE
+// pointers stay valid
+struct PTE *procChunks[PROCCHUNKS];
+int procTableSlots;
+// Cold half of the table, allocated the first time one of its slots is used
+PTECold *coldChunks[PROCCHUNKS];
+// Tables the other phases keep for each process, found by procShadow()
+// from a PID so they grow along with this one
+char *shadowChunks[MAXSHADOWS][PROCCHUNKS];
+int shadowSizes[MAXSHADOWS];
+int numShadows;
+// Empty slots in the order they were freed, a circular queue so the
+// slot used longest ago is reused first
+int freeSlots[PROCTABLEMAX];
+int freeSlotsHead;
+int freeSlotsCount;
+// How many times each slot has been reused, PID = slot + generation * 
+// PROCTABLEMAX so procSlot() is still the slot but an old PID never names a
+// new process. A slot whose next PID would not fit in an int is retired,
+// never reused
+int slotGeneration[PROCTABLEMAX];
 // Keep track of the total alive process in the table
 int processTableCount;
 // Each entry is a linked list, index 0 is priority 1, etc
 // Two dimensional because we want front and back of the linked list
 queue *priorityQueue[MINPRIORITY][2];
+// Stacks of reaped processes by size class, reused before asking for more
+freeStack *stackPool[STACKCLASSES];
+// Counters any phase can register, see statRegister()
+kernelStat stats[MAXSTATS];
+int numStats;
+// CPU time a process used before each context switch away from it
+int statSlice = -1;
+// fork, join and zap latency in microseconds, and used slots at each fork
+int statFork = -1, statJoin = -1, statZap = -1, statTableUsed = -1;
+// Ready queue and zapper nodes are recycled here instead of going back to
+// malloc, every process is on at most one of each so more than 
+// 2 * PROCTABLEMAX
+// live nodes means a leak
+queue *freeQueueNodes;
+int liveQueueNodes;
+// What a blocked process waits for in part 2 and part 3, for the wait-for
+// graph. Those phases install their lookups from their init, part 1 alone
+// only knows about join and zap
+int (*mboxWaitLookup)(int pid) = noWaitLookup;
+int (*semWaitLookup)(int pid) = noWaitLookup;
+// Called for every new process once it has an address space, part 5 uses it
+// to share the parent's pages
+void (*forkHook)(int parent, int child) = noForkHook;
+// Paging stats of a process for dumpProc(), installed by part 5
+int (*procStatsHook)(int pid, int *rss, int *major, int *minor, int *ref, 
+						int *dirty) = noProcStats;
 /* ------------------------------------------------------------------------- */
 
 /* ------------------------------------------------------ Required Functions */
@@ -108,19 +227,34 @@ void part1_init(void){
 	checkKernelMode("part1_init");
 	currProcess = -1;
 	// initialize process table with all 0 entries
-	memset(procTable, 0, MAXPROC * sizeof(PTE)); 
+	memset(procChunks, 0, PROCCHUNKS * sizeof(PTE *)); 
+	memset(coldChunks, 0, PROCCHUNKS * sizeof(PTECold *));
+	memset(shadowChunks, 0, MAXSHADOWS * PROCCHUNKS * sizeof(char *));
+	procTableSlots = 0;
+	numShadows = 0;
+	memset(stackPool, 0, STACKCLASSES * sizeof(freeStack *));
 	// initialize priority queues
 	for (int i = 0; i < MINPRIORITY; i++) {
 		priorityQueue[i][0] = NULL;
 		priorityQueue[i][1] = NULL;
 	}
+	// every slot of the first chunk but the reserved ones is free, slot 0 
+	// starts at generation 1 so that no process gets PID 0
+	memset(slotGeneration, 0, PROCTABLEMAX * sizeof(int));
+	slotGeneration[0] = 1;
+	freeSlotsHead = 0;
+	freeSlotsCount = 0;
+	growTable();
 	// set up init
-	currPID = 1;
-	newProcess(currPID, "init", currPID, 6, init, "", USLOSS_MIN_STACK, 0);
-	currPID++;
+	newProcess(1, "init", 1, 6, init, "", USLOSS_MIN_STACK, -1);
 	processTableCount = 1;
 	
 	USLOSS_IntVec[USLOSS_CLOCK_INT] = clockHandler;
+	statSlice = statRegister("dispatch_slice_us");
+	statFork = statRegister("fork_us");
+	statJoin = statRegister("join_us");
+	statZap = statRegister("zap_us");
+	statTableUsed = statRegister("proc_table_used");
 }
 
 /*
@@ -137,29 +271,75 @@ int fork(char *name, int(*func)(char *), char *arg, int stacksize, int priority)
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
 	// make sure all inputs are valid
-	if (stacksize < USLOSS_MIN_STACK) return -2;
+	if (stacksize < USLOSS_MIN_STACK) {
+		restoreInterrupt(currPSR);
+		return -2;
+	}
 	if (strlen(name) > MAXNAME || name == NULL
 			|| (arg != NULL && strlen(arg) > MAXARG) 
 			|| priority < 1 || priority > 5
-			|| processTableCount >= MAXPROC) {
+			|| (freeSlotsCount == 0 && ! growTable())) {
+		restoreInterrupt(currPSR);
 		return -1;
 	}
-	// find empty spot on the process table
-	while (1) {
-		if (procTable[currPID % MAXPROC].state != EMPTY)
-			currPID++;
-		else break;
-	}
-	int slot = currPID % MAXPROC;
+	int start = statStart();
+	// take the empty slot freed longest ago
+	int slot = allocateSlot();
+	int pid = slot + slotGeneration[slot] * PROCTABLEMAX;
 	// set up the process
-	newProcess(slot, name, currPID, priority, func, arg, stacksize, currProcess);
-	currPID++;
+	newProcess(slot, name, pid, priority, func, arg, stacksize, procSlot(currProcess));
+	statRecord(statTableUsed, processTableCount);
 	// call dispatcher, parent run first
-	if (priority < procTable[currProcess % MAXPROC].priority)
+	if (priority < procEntry(procSlot(currProcess)) -> priority)
+		dispatcher();
+	statLatency(statFork, start);
+	// restore interrupt
+	restoreInterrupt(currPSR);
+	return pid;
+}
+
+/*
+ * Create count identical children in one critical section
+ * setup(pid, data) is called for each child before any of them can run, 
+ * and the dispatcher is called once after all of them are created
+ * The PIDs go into pids[], stops early if the process table fills up
+ * @return:		-2, if stacksize is less than USLOSS_MIN_STACK
+ * 				-1, if count is not positive, priority out of range,
+ * 					startFunc or name are NULL, or name too long
+ * 				>=0, number of children created
+ */
+int forkMany(char *name, int(*func)(char *), char *arg, int stacksize, int priority,
+				int count, int *pids, void (*setup)(int, void *), void *data) {
+	// check kernel mode and disable interrupt
+	checkKernelMode("forkMany");
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	// make sure all inputs are valid
+	if (stacksize < USLOSS_MIN_STACK) {
+		restoreInterrupt(currPSR);
+		return -2;
+	}
+	if (name == NULL || strlen(name) > MAXNAME || func == NULL
+			|| (arg != NULL && strlen(arg) > MAXARG) 
+			|| priority < 1 || priority > 5 || count <= 0) {
+		restoreInterrupt(currPSR);
+		return -1;
+	}
+	int created = 0;
+	for (; created < count && (freeSlotsCount > 0 || growTable()); created++) {
+		int slot = allocateSlot();
+		int pid = slot + slotGeneration[slot] * PROCTABLEMAX;
+		newProcess(slot, name, pid, priority, func, arg, stacksize, 
+					procSlot(currProcess));
+		pids[created] = pid;
+		if (setup != NULL) setup(pid, data);
+	}
+	// call dispatcher once for the whole batch, parent run first
+	if (created > 0 && priority < procEntry(procSlot(currProcess)) -> priority)
 		dispatcher();
 	// restore interrupt
 	restoreInterrupt(currPSR);
-	return procTable[slot].PID;
+	return created;
 }
 
 /*
@@ -173,22 +353,24 @@ int join(int *status) {
 	checkKernelMode("join");
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
+	int start = statStart();
 	// check the children
-	int slot = currProcess % MAXPROC;
-	PTE *currChild = procTable[slot].lastChild;
-	if (procTable[slot].numChildren == 0) {
+	int slot = procSlot(currProcess);
+	PTE *currChild = procEntry(slot) -> lastChild;
+	if (procEntry(slot) -> numChildren == 0) {
 		restoreInterrupt(currPSR);
 		return -2;
 	}
-	int deadPID;
+	int deadPID = -2;
 	for (; currChild != NULL;) {
 		// found a dead child, return immediately
 		if (currChild -> state == DYING || currChild -> state == DEAD) {
 			*status = currChild -> quitStatus;
 			deadPID = currChild -> PID;
 			// clear out this entry on the process table
-			procTable[currChild -> PID % MAXPROC].read = 1;
-			deleteProcess(currChild -> PID % MAXPROC);
+			procEntry(procSlot(currChild -> PID)) -> read = 1;
+			deleteProcess(procSlot(currChild -> PID));
+			statLatency(statJoin, start);
 			// return quit status
 			restoreInterrupt(currPSR);
 			return deadPID;
@@ -199,18 +381,19 @@ int join(int *status) {
 	// block the current process
 	blockMe(CODEJOIN);
 	// check if a child has died
-	currChild = procTable[slot].lastChild;
+	currChild = procEntry(slot) -> lastChild;
 	for (; currChild != NULL;) {
 		if (currChild -> state == DYING || currChild -> state == DEAD) {
 			*status = currChild -> quitStatus;
 			deadPID = currChild -> PID;
 			// clear out this entry on the process table
-			procTable[currChild -> PID % MAXPROC].read = 1;
-			deleteProcess(currChild->PID % MAXPROC);
+			procEntry(procSlot(currChild -> PID)) -> read = 1;
+			deleteProcess(procSlot(currChild -> PID));
 			break;
 		}
 		currChild = currChild -> olderSibling;
 	}
+	statLatency(statJoin, start);
 	// return quit status
 	restoreInterrupt(currPSR);
 	return deadPID;
@@ -226,25 +409,27 @@ void quit(int status) {
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
 	// mark current process as dead
-	int slot = currProcess % MAXPROC;
-	procTable[slot].state = DYING;
-	procTable[slot].quitStatus = status;
-	if (procTable[slot].numChildren != 0) {
+	PTE *self = procEntry(procSlot(currProcess));
+	self -> state = DYING;
+	self -> quitStatus = status;
+	if (self -> numChildren != 0) {
 		USLOSS_Console("ERROR: Process pid %d called quit() while it still had children.\n", currProcess);
 		USLOSS_Halt(1);
 	}
 	// check join and zap and wake up everyone
-	if (procTable[slot].parent -> state == BLOCKED) 
-		unblockProc(procTable[slot].parent -> PID);
-	if (procTable[slot].isZapped) {
-		for ( ; procTable[slot].zappers != NULL;) {
-			queue *temp = procTable[slot].zappers;
-			procTable[slot].zappers = procTable[slot].zappers -> next;
-			if (procTable[(temp->PID) % MAXPROC].state == BLOCKED)
-				unblockProc(procTable[(temp->PID) % MAXPROC].PID);
+	if (self -> parent -> state == BLOCKED) 
+		unblockProc(self -> parent -> PID);
+	if (self -> isZapped) {
+		for ( ; self -> zappers != NULL;) {
+			queue *temp = self -> zappers;
+			self -> zappers = self -> zappers -> next;
+			int zapper = temp -> PID;
+			freeQueueNode(temp);
+			if (procEntry(procSlot(zapper)) -> state == BLOCKED)
+				unblockProc(procEntry(procSlot(zapper)) -> PID);
 		}
 	}
-	procTable[slot].state = DEAD;
+	self -> state = DEAD;
 	mmu_quit(currProcess);
 	// call dispatcher
 	dispatcher();
@@ -260,17 +445,18 @@ int zap(int pid) {
 	checkKernelMode("zap");
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
+	PTE *target = procEntry(procSlot(pid));
 	// check for error
 	if (pid <= 0) {
 		USLOSS_Console("ERROR: Attempt to zap() a PID which is <=0.  other_pid = %d\n", pid);
 		USLOSS_Halt(1);
-	} else if (procTable[pid % MAXPROC].state == EMPTY) {
+	} else if (target -> state == EMPTY) {
 		USLOSS_Console("ERROR: Attempt to zap() a non-existent process.\n");
 		USLOSS_Halt(1);
-	} else if (procTable[pid % MAXPROC].state == DYING) {
+	} else if (target -> state == DYING) {
 		USLOSS_Console("ERROR: Attempt to zap() a process that is already in the process of dying.\n");
 		USLOSS_Halt(1);
-	} else if (procTable[pid % MAXPROC].state == DEAD) {
+	} else if (target -> state == DEAD) {
 		USLOSS_Console("ERROR: Attempt to zap() a process that is already in the process of dying.\n");
 		USLOSS_Halt(1);
 	} else if (pid == 1) {
@@ -279,39 +465,35 @@ int zap(int pid) {
 	} else if (pid == currProcess) {
 		USLOSS_Console("ERROR: Attempt to zap() itself.\n");
 		USLOSS_Halt(1);
-	} else if (procTable[pid % MAXPROC].PID != pid) {
+	} else if (target -> PID != pid) {
 		USLOSS_Console("ERROR: Attempt to zap() a non-existent process.\n");
 		USLOSS_Halt(1);
 	}
 	// return 0 if already quit
-	if (procTable[pid % MAXPROC].state == DEAD) {
+	if (target -> state == DEAD) {
 		restoreInterrupt(currPSR);
 		return 0;
 	}
 	// Zap
-	procTable[pid % MAXPROC].isZapped = 1;
-	procTable[pid % MAXPROC].numZapped++;
-	queue *newZapper = malloc(sizeof(queue));
-	if (newZapper == NULL) {
-		USLOSS_Trace("Error: Out of memory! \n");
-		USLOSS_Halt(1);
-	}
-	newZapper -> next = NULL;
-	newZapper -> PID = currProcess;
-	if (procTable[pid % MAXPROC].zappers == NULL) 
-		procTable[pid % MAXPROC].zappers = newZapper;
+	int start = statStart();
+	target -> isZapped = 1;
+	target -> numZapped++;
+	queue *newZapper = newQueueNode(currProcess);
+	procEntry(procSlot(currProcess)) -> zapTarget = pid;
+	if (target -> zappers == NULL) 
+		target -> zappers = newZapper;
 	else {
-		int newPriority = procTable[newZapper -> PID % MAXPROC].priority;
-		queue *curr = procTable[pid % MAXPROC].zappers;
-		if (newPriority < procTable[curr -> PID % MAXPROC].priority) {
+		int newPriority = procEntry(procSlot(newZapper -> PID)) -> priority;
+		queue *curr = target -> zappers;
+		if (newPriority < procEntry(procSlot(curr -> PID)) -> priority) {
 			newZapper -> next = curr;
-			procTable[pid % MAXPROC].zappers = newZapper;
+			target -> zappers = newZapper;
 		} else {
 			for (; curr != NULL; curr = curr -> next) {
 				if (curr -> next == NULL) {
 					curr -> next = newZapper;
 					break;
-				} else if (newPriority < procTable[curr -> next -> PID % MAXPROC].priority) {
+				} else if (newPriority < procEntry(procSlot(curr -> next -> PID)) -> priority) {
 					newZapper -> next = curr -> next;
 					curr -> next = newZapper;
 					break;
@@ -320,8 +502,9 @@ int zap(int pid) {
 		}
 	}
 	blockMe(CODEZAP);
+	statLatency(statZap, start);
 	restoreInterrupt(currPSR);
-	if (procTable[pid % MAXPROC].state >= DYING || procTable[pid % MAXPROC].state == EMPTY) 
+	if (target -> state >= DYING || target -> state == EMPTY) 
 		return 0;
 	else return 1;
 }
@@ -333,7 +516,7 @@ int zap(int pid) {
  */
 int isZapped(void) {
 	checkKernelMode("isZapped");
-	return procTable[currProcess % MAXPROC].isZapped;
+	return procEntry(procSlot(currProcess)) -> isZapped;
 }
 
 /*
@@ -353,25 +536,134 @@ void dumpProc() {
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
 	USLOSS_Console(" PID  PPID  NAME              PRIORITY  STATE\n");
-	for (int i = 0; i < MAXPROC; i++) {
-		if (procTable[i].state == EMPTY) continue;
-		int pid = procTable[i].PID;
+	for (int i = 0; i < procTableSlots; i++) {
+		if (procEntry(i) -> state == EMPTY) continue;
+		int pid = procEntry(i) -> PID;
 		int ppid;
 		if (pid == 1) ppid = 0;
-		else ppid = procTable[i].parent -> PID;
-		char *name = procTable[i].name;
-		int priority = procTable[i].priority;
+		else ppid = procEntry(i) -> parent -> PID;
+		char *name = coldEntry(i) -> name;
+		int priority = procEntry(i) -> priority;
 		USLOSS_Console("%4d  %4d  %-17s %-10d", pid, ppid, name, priority);
-		if (currProcess == pid) USLOSS_Console("Running\n", procTable[i].quitStatus);
-		else if (procTable[i].state == READY) USLOSS_Console("Runnable\n");
-		else if (procTable[i].state == DYING || procTable[i].state == DEAD) USLOSS_Console("Terminated(%d)\n", procTable[i].quitStatus);
-		else if (procTable[i].state == BLOCKED) {
+		if (currProcess == pid) USLOSS_Console("Running\n", procEntry(i) -> quitStatus);
+		else if (procEntry(i) -> state == READY) USLOSS_Console("Runnable\n");
+		else if (procEntry(i) -> state == DYING || procEntry(i) -> state == DEAD) USLOSS_Console("Terminated(%d)\n", procEntry(i) -> quitStatus);
+		else if (procEntry(i) -> state == BLOCKED) {
 			USLOSS_Console("Blocked");
-			if (procTable[i].runnableStatus == CODEJOIN) USLOSS_Console("(waiting for child to quit)\n");
-			else if (procTable[i].runnableStatus == CODEZAP) USLOSS_Console("(waiting for zap target to quit)\n");
-			else USLOSS_Console("(%d)\n", procTable[i].runnableStatus);
+			if (procEntry(i) -> runnableStatus == CODEJOIN) USLOSS_Console("(waiting for child to quit)\n");
+			else if (procEntry(i) -> runnableStatus == CODEZAP) USLOSS_Console("(waiting for zap target to quit)\n");
+			else USLOSS_Console("(%d)\n", procEntry(i) -> runnableStatus);
 		}
 	}
+	// paging stats get their own table, the one above is left as it was
+	// before part 5 existed
+	int header = 0;
+	for (int i = 0; i < procTableSlots; i++) {
+		if (procEntry(i) -> state == EMPTY) continue;
+		int rss, major, minor, ref, dirty;
+		if (procStatsHook(procEntry(i) -> PID, &rss, &major, &minor, &ref, &dirty) != 0) 
+			continue;
+		if (! header) USLOSS_Console(" PID  RSS  MAJFLT  MINFLT  REF  DIRTY\n");
+		header = 1;
+		USLOSS_Console("%4d  %3d  %6d  %6d  %3d  %5d\n", procEntry(i) -> PID, rss, 
+						major, minor, ref, dirty);
+	}
+	restoreInterrupt(currPSR);
+}
+
+/*
+ * Get the id of a named stat, creating it the first time
+ * Any phase can call this from its init, the same name gives the same id
+ * A stat that does not fit is reported once and then never recorded
+ * @return:		-1, if there are already MAXSTATS stats
+ * 				>=0, the id to pass to statRecord()
+ */
+int statRegister(char *name) {
+	for (int i = 0; i < numStats; i++) 
+		if (strcmp(stats[i].name, name) == 0) return i;
+	if (numStats == MAXSTATS) {
+		USLOSS_Console("WARNING: stat %s not registered, all %d stats are taken. ", 
+						name, MAXSTATS);
+		USLOSS_Console("Raise MAXSTATS in part1.c.\n");
+		return -1;
+	}
+	strncpy(stats[numStats].name, name, MAXNAME - 1);
+	return numStats++;
+}
+
+/*
+ * Add one sample to a stat, O(1) and safe to call from interrupt handlers
+ */
+void statRecord(int id, int value) {
+	if (id < 0 || id >= numStats) return;
+	if (value < 0) value = 0;
+	kernelStat *stat = &stats[id];
+	int bucket = 0;
+	while (bucket < STATBUCKETS - 1 && (1 << bucket) <= value) bucket++;
+	stat -> buckets[bucket]++;
+	stat -> count++;
+	stat -> total += value;
+	if (value > stat -> max) stat -> max = value;
+}
+
+/*
+ * Start timing a kernel operation for a latency stat
+ * Reading the clock is a device access with the PSR saved and restored, 
+ * twice per operation, so latency stats are only kept in builds with
+ * STATTIMING defined
+ * @return:		-1, if latency stats are off
+ * 				>=0, the time to pass to statLatency()
+ */
+int statStart() {
+#ifdef STATTIMING
+	return currentTime();
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Record the time since statStart() in a stat, nothing if stats are off
+ */
+void statLatency(int id, int start) {
+	if (start == -1) return;
+	statRecord(id, currentTime() - start);
+}
+
+/*
+ * Return an upper bound on the given percentile of a stat
+ * Exact to within a factor of 2, never more than the largest sample
+ */
+int statPercentile(int id, int percent) {
+	kernelStat *stat = &stats[id];
+	long rank = ((long) stat -> count * percent + 99) / 100;
+	long seen = 0;
+	for (int i = 0; i < STATBUCKETS; i++) {
+		seen += stat -> buckets[i];
+		if (seen >= rank && seen > 0) {
+			int bound = i == 0 ? 0 : (1 << i) - 1;
+			return bound < stat -> max ? bound : stat -> max;
+		}
+	}
+	return stat -> max;
+}
+
+/*
+ * Print every stat on its own line, one key=value per field, so runs of 
+ * different kernel builds can be compared with a script
+ */
+void dumpStats() {
+	checkKernelMode("dumpStats");
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	for (int i = 0; i < numStats; i++) {
+		kernelStat *stat = &stats[i];
+		if (stat -> count == 0) continue;
+		USLOSS_Console("STAT name=%s count=%d total=%ld mean=%ld p50=%d p90=%d p99=%d max=%d\n",
+						stat -> name, stat -> count, stat -> total, 
+						stat -> total / stat -> count, statPercentile(i, 50),
+						statPercentile(i, 90), statPercentile(i, 99), stat -> max);
+	}
 	restoreInterrupt(currPSR);
 }
 
@@ -389,8 +681,13 @@ int blockMe(int block_status) {
         USLOSS_Halt(1);
     }
 	// block the current process
-	procTable[currProcess % MAXPROC].state = BLOCKED;
-	procTable[currProcess % MAXPROC].runnableStatus = block_status;
+	PTE *self = procEntry(procSlot(currProcess));
+	self -> state = BLOCKED;
+	self -> runnableStatus = block_status;
+	// a clock read on every block, only kept with the latency stats
+	self -> blockedSince = statStart();
+	if (block_status == CODEJOIN || block_status == CODEZAP) 
+		checkWaitCycle(currProcess);
 	dispatcher();
 	restoreInterrupt(currPSR);
     return 0;
@@ -407,16 +704,18 @@ int unblockProc(int pid) {
 	checkKernelMode("unblockProc");
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
+	PTE *target = procEntry(procSlot(pid));
 	// check error
-	if (procTable[pid % MAXPROC].state == EMPTY
-			|| procTable[pid % MAXPROC].runnableStatus <= 10
-			|| procTable[pid % MAXPROC].state != BLOCKED) {
+	if (target -> state == EMPTY
+			|| target -> PID != pid
+			|| target -> runnableStatus <= 10
+			|| target -> state != BLOCKED) {
 		USLOSS_Console("Error when unblock\n");
 		USLOSS_Halt(1);
 	}
 	// unblock
-	procTable[pid % MAXPROC].state = READY;
-	procTable[pid % MAXPROC].runnableStatus = 0;
+	target -> state = READY;
+	target -> runnableStatus = 0;
 	enqueue(pid);
 	// call dispatcher
 	dispatcher();
@@ -431,7 +730,7 @@ int unblockProc(int pid) {
  */
 int readCurStartTime() {
 	checkKernel(); // why this cannot be changed to checkKernelMode("readCurStartTime")?
-	return procTable[currProcess % MAXPROC].currTimeSliceStart;
+	return procEntry(procSlot(currProcess)) -> currTimeSliceStart;
 }
 
 /*
@@ -503,19 +802,20 @@ static void dispatcher() {
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
 
-	if (procTable[currProcess % MAXPROC].state == DYING) return;
+	if (currProcess != -1 && procEntry(procSlot(currProcess)) -> state == DYING) 
+		return;
 
 	// set up stuff for switch
 	int toSwitch = 1;		// flag
 	int oldPID = currProcess;
 	int newPID = -1;
-	int isBlocked;		// flag
-	if (procTable[oldPID % MAXPROC].state == BLOCKED) isBlocked = 1;
+	int isBlocked = 0;	// flag
 	int timeSliceUp = 0;	// flag
-	int currPriority = procTable[oldPID % MAXPROC].priority;
-	// check to switch or not and how to switch
+	// check to switch or not and how to switch, there is no old process at boot
 	if (oldPID == -1) newPID = 1;
 	else {
+		if (procEntry(procSlot(oldPID)) -> state == BLOCKED) isBlocked = 1;
+		int currPriority = procEntry(procSlot(oldPID)) -> priority;
 		// check if there's a process with higher priority
 		int i = 0;
 		for (; i < currPriority - 1; i++) {
@@ -527,7 +827,7 @@ static void dispatcher() {
 		// if none found, check block and time slice
 		if (newPID == -1) {
 			// if blocked or dead, must switch
-			if (isBlocked || procTable[oldPID % MAXPROC].state == DEAD) {
+			if (isBlocked || procEntry(procSlot(oldPID)) -> state == DEAD) {
 				for (; i < MINPRIORITY; i++) {
 					if (peek(i) != -1) {
 						newPID = dequeue(i);
@@ -555,18 +855,21 @@ static void dispatcher() {
 		currProcess = newPID;
 		mmu_switch(newPID);
 		//dequeue(newPID);
-		if ((isBlocked != 1) && (oldPID != -1) && (procTable[oldPID].state != DEAD)) enqueue(oldPID);	
-		procTable[oldPID % MAXPROC].CPUTime += readtime();
-		procTable[newPID % MAXPROC].currTimeSliceStart = currentTime();
-		if (procTable[oldPID % MAXPROC].state == DEAD && procTable[oldPID % MAXPROC].read) {
-			memset(&procTable[oldPID % MAXPROC], 0, 1 * sizeof(PTE));
-			processTableCount--;
+		if ((isBlocked != 1) && (oldPID != -1) && (procEntry(procSlot(oldPID)) -> state != DEAD)) enqueue(oldPID);	
+		int used = readtime();
+		if (oldPID != -1) {
+			procEntry(procSlot(oldPID)) -> CPUTime += used;
+			statRecord(statSlice, used);
 		}
+		procEntry(procSlot(newPID)) -> currTimeSliceStart = currentTime();
+		if (oldPID != -1 && procEntry(procSlot(oldPID)) -> state == DEAD 
+				&& procEntry(procSlot(oldPID)) -> read) 
+			releaseSlot(procSlot(oldPID));
 		if (oldPID == -1)
-			USLOSS_ContextSwitch(NULL, &procTable[newPID % MAXPROC].context);
+			USLOSS_ContextSwitch(NULL, &coldEntry(procSlot(newPID)) -> context);
 		else {
-			USLOSS_ContextSwitch(&procTable[oldPID % MAXPROC].context,
-									&procTable[newPID % MAXPROC].context);
+			USLOSS_ContextSwitch(&coldEntry(procSlot(oldPID)) -> context,
+									&coldEntry(procSlot(newPID)) -> context);
 		}
 	} else {
 		if (isBlocked) {
@@ -575,7 +878,7 @@ static void dispatcher() {
 			USLOSS_Halt(1);
 		}
 		if (timeSliceUp)
-			procTable[currProcess % MAXPROC].currTimeSliceStart = currentTime();
+			procEntry(procSlot(currProcess)) -> currTimeSliceStart = currentTime();
 	}
 	// restore interrupt
 	restoreInterrupt(currPSR);
@@ -589,16 +892,10 @@ void enqueue(int pid) {
 		printf("error enqueue\n");
 		return;
 	}
-	int slot = pid % MAXPROC;
-	int priority = procTable[slot].priority;
+	int slot = procSlot(pid);
+	int priority = procEntry(slot) -> priority;
 	
-	queue *newQueue = malloc(sizeof(queue));
-	if (newQueue == NULL) {
-		USLOSS_Trace("Error: Out of memory! \n");
-		USLOSS_Halt(1);
-	}
-	newQueue -> PID = pid;
-	newQueue -> next = NULL;
+	queue *newQueue = newQueueNode(pid);
 
 	if (priorityQueue[priority - 1][0] == NULL) {
 		priorityQueue[priority - 1][0] = newQueue;
@@ -620,10 +917,44 @@ int dequeue(int index) {
 		priorityQueue[index][1] = NULL;
 	} else
 		priorityQueue[index][0] = temp -> next;
-	free(temp);
+	freeQueueNode(temp);
 	return pid;
 }
 
+/*
+ * Get a queue node for pid, recycled if possible
+ * Halt if the number of live nodes shows a leak, long runs would otherwise
+ * only find out when memory runs out
+ */
+queue *newQueueNode(int pid) {
+	queue *node = freeQueueNodes;
+	if (node != NULL) freeQueueNodes = node -> next;
+	else {
+		node = malloc(sizeof(queue));
+		if (node == NULL) {
+			USLOSS_Trace("Error: Out of memory! \n");
+			USLOSS_Halt(1);
+		}
+	}
+	if (++liveQueueNodes > 2 * PROCTABLEMAX) {
+		USLOSS_Console("ERROR: %d ready queue and zapper nodes are live, ", liveQueueNodes);
+		USLOSS_Console("more than 2 per process. The kernel leaks them.\n");
+		USLOSS_Halt(1);
+	}
+	node -> PID = pid;
+	node -> next = NULL;
+	return node;
+}
+
+/*
+ * Give a queue node back for reuse
+ */
+void freeQueueNode(queue *node) {
+	node -> next = freeQueueNodes;
+	freeQueueNodes = node;
+	liveQueueNodes--;
+}
+
 /*
  * Look at the first element in the queue and return its PID
  * Return -1 if the queue is empty
@@ -637,6 +968,12 @@ int peek(int index) {
  * Function for init process
  */
 int init(char *str) {
+	// set up sentinel first, it always gets PID 2 from its reserved slot, and
+	// it keeps the CPU while the service processes wait for their devices
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	newProcess(2, "sentinel", 2, 7, sentinel, "", USLOSS_MIN_STACK, 1);
+	restoreInterrupt(currPSR);
 	// for Bootstrap process?
 	phase2_start_service_processes();
 	phase3_start_service_processes();
@@ -644,43 +981,37 @@ int init(char *str) {
 	phase5_start_service_processes();
 	// first disable interrupt
 	disableInterrupt();
-	int currPSR = USLOSS_PsrGet();
-	// set up sentinel
-	if (currPID != 2) {
-		USLOSS_Trace("Error: PID not 2 when sentinel is created\n");
-		exit(1);
-	}
-	newProcess(2, "sentinel", currPID, 7, sentinel, "", USLOSS_MIN_STACK, 1);
-	currPID++;
+	currPSR = USLOSS_PsrGet();
 	// set up testcase_main
 	char *name = "testcase_main";
 	char *arg = "";
-	strcpy(procTable[3].name, name);
-	procTable[3].PID = currPID;
-	procTable[3].priority = 5;
-	strcpy(procTable[3].arg, arg);
-	procTable[3].testCaseMain = testcase_main;
-	procTable[3].stacksize = USLOSS_MIN_STACK;
-	procTable[3].parent = &procTable[1];
-	procTable[1].numChildren++;
-	procTable[3].olderSibling = &procTable[2];
-	procTable[3].youngerSibling = NULL;
-	procTable[3].numChildren = 0;
-	procTable[3].state = READY;
-	procTable[3].runnableStatus = 0;
-	procTable[3].isZapped = 0;
-	procTable[3].zappers = NULL;
-	procTable[3].numZapped = 0;
-	procTable[3].CPUTime = 0;
-	procTable[3].currTimeSliceStart = 0;
+	strcpy(coldEntry(3) -> name, name);
+	procEntry(3) -> PID = 3;
+	procEntry(3) -> priority = 5;
+	strcpy(coldEntry(3) -> arg, arg);
+	coldEntry(3) -> testCaseMain = testcase_main;
+	coldEntry(3) -> stacksize = USLOSS_MIN_STACK;
+	procEntry(3) -> parent = procEntry(1);
+	procEntry(1) -> numChildren++;
+	procEntry(3) -> olderSibling = procEntry(2);
+	procEntry(3) -> youngerSibling = NULL;
+	procEntry(3) -> numChildren = 0;
+	procEntry(3) -> state = READY;
+	procEntry(3) -> runnableStatus = 0;
+	procEntry(3) -> isZapped = 0;
+	procEntry(3) -> zappers = NULL;
+	procEntry(3) -> numZapped = 0;
+	procEntry(3) -> CPUTime = 0;
+	procEntry(3) -> currTimeSliceStart = 0;
 	mmu_init_proc(3);
 	processTableCount++;
-	USLOSS_ContextInit(&(procTable[3].context),
-						malloc(USLOSS_MIN_STACK),
-						procTable[3].stacksize,
-						procTable[3].context.pageTable,
+	coldEntry(3) -> stack = allocateStack(USLOSS_MIN_STACK, &coldEntry(3) -> stackClass,
+											&coldEntry(3) -> stackBytes);
+	USLOSS_ContextInit(&(coldEntry(3) -> context),
+						coldEntry(3) -> stack,
+						coldEntry(3) -> stacksize,
+						coldEntry(3) -> context.pageTable,
 						launcher);
-	currPID++;
 	// add to the ready process queue
 	enqueue(3);
 	// restore interrupt
@@ -705,6 +1036,7 @@ int sentinel(char *str) {
 	while (1) {
 		if (phase2_check_io() == 0) {
 			USLOSS_Console("DEADLOCK DETECTED!  All of the processes have blocked, but I/O is not ongoing.\n");
+			dumpWaitGraph();
 			USLOSS_Halt(1);
 		}
 		USLOSS_WaitInt();
@@ -712,6 +1044,91 @@ int sentinel(char *str) {
 	return 0;
 }
 
+/*
+ * The one process a blocked process waits for, -1 if it is not blocked, 
+ * waits on a mailbox or semaphore, or join() can be satisfied by several
+ * children. Only these edges can close a cycle nobody else can break
+ */
+int waitSuccessor(int slot) {
+	if (procEntry(slot) -> state != BLOCKED) return -1;
+	if (procEntry(slot) -> runnableStatus == CODEZAP) 
+		return procSlot(procEntry(slot) -> zapTarget);
+	if (procEntry(slot) -> runnableStatus == CODEJOIN && procEntry(slot) -> numChildren == 1)
+		return procSlot(procEntry(slot) -> lastChild -> PID);
+	return -1;
+}
+
+/*
+ * Called when pid adds a join or zap edge to the wait-for graph
+ * Every process has at most one such edge, so following them from pid
+ * finds any new cycle in O(length of the chain)
+ */
+void checkWaitCycle(int pid) {
+	int start = procSlot(pid);
+	int curr = waitSuccessor(start);
+	for (int steps = 0; curr != -1 && curr != start && steps < procTableSlots; steps++) 
+		curr = waitSuccessor(curr);
+	if (curr != start) return;
+	int now = currentTime();
+	USLOSS_Console("DEADLOCK CYCLE DETECTED! ");
+	USLOSS_Console("These processes wait for each other and cannot be woken up:\n");
+	curr = start;
+	do {
+		printWaitEdge(curr, now);
+		curr = waitSuccessor(curr);
+	} while (curr != start);
+}
+
+/*
+ * Print the wait-for edge of one blocked process and how long it has existed,
+ * the age is only known in builds with STATTIMING
+ */
+void printWaitEdge(int slot, int now) {
+	int pid = procEntry(slot) -> PID;
+	USLOSS_Console("  %4d %-17s waits for ", pid, coldEntry(slot) -> name);
+	int status = procEntry(slot) -> runnableStatus;
+	int mbox = mboxWaitLookup(pid);
+	int sem = semWaitLookup(pid);
+	if (status == CODEZAP) 
+		USLOSS_Console("process %d to quit (zap)", procEntry(slot) -> zapTarget);
+	else if (status == CODEJOIN) {
+		USLOSS_Console("one of its children to quit (join):");
+		for (PTE *child = procEntry(slot) -> firstChild; child != NULL; 
+				child = child -> youngerSibling) 
+			USLOSS_Console(" %d", child -> PID);
+	} else if (sem != -1) 
+		USLOSS_Console("semaphore %d", sem);
+	else if (mbox != -1) 
+		USLOSS_Console("mailbox %d", mbox);
+	else USLOSS_Console("block status %d", status);
+	if (procEntry(slot) -> blockedSince == -1) USLOSS_Console("\n");
+	else USLOSS_Console(", since %d us ago\n", now - procEntry(slot) -> blockedSince);
+}
+
+/*
+ * Called by part 2 and part 3 from their init to say which mailbox or
+ * semaphore a process is blocked on, NULL keeps the current lookup
+ */
+void registerWaitLookups(int (*mbox)(int), int (*sem)(int)) {
+	if (mbox != NULL) mboxWaitLookup = mbox;
+	if (sem != NULL) semWaitLookup = sem;
+}
+
+/*
+ * The lookup used until a phase installs its own, nobody waits on anything
+ */
+int noWaitLookup(int pid) { return -1; }
+
+/*
+ * Print the whole wait-for graph, one edge per blocked process
+ */
+void dumpWaitGraph() {
+	int now = currentTime();
+	USLOSS_Console("Wait-for graph:\n");
+	for (int i = 0; i < procTableSlots; i++) 
+		if (procEntry(i) -> state == BLOCKED) printWaitEdge(i, now);
+}
+
 /*
  * Check if the Current mode bit on the PSR is 1
  */
@@ -769,85 +1186,314 @@ void enableInterrupt() {
 /*
  * Create a new process on the process table
  * Then call USLOSS_ContextInit() to initialize the process
+ * parentSlot is -1 for init, which has no parent
  */
 void newProcess(int slot, char *name, int PID, int priority,
 					int (*func)(char *), char *arg, int stacksize,
 					int parentSlot) {
-	strcpy(procTable[slot].name, name);
-	procTable[slot].PID = PID;
-	procTable[slot].priority = priority;
-	if (arg == NULL) strcpy(procTable[slot].arg, "");
-	else strcpy(procTable[slot].arg, arg);
-	procTable[slot].func = func;
-	procTable[slot].stacksize = stacksize;
-	procTable[slot].testCaseMain = NULL;
-	if (parentSlot == 0) {
-		procTable[slot].parent = NULL;
-		procTable[slot].firstChild = NULL;
-		procTable[slot].lastChild = NULL; // TO MATCH TEST CASES
-		procTable[slot].olderSibling = NULL;
-		procTable[slot].youngerSibling = NULL;
+	strcpy(coldEntry(slot) -> name, name);
+	procEntry(slot) -> PID = PID;
+	procEntry(slot) -> priority = priority;
+	if (arg == NULL) strcpy(coldEntry(slot) -> arg, "");
+	else strcpy(coldEntry(slot) -> arg, arg);
+	coldEntry(slot) -> func = func;
+	coldEntry(slot) -> stacksize = stacksize;
+	coldEntry(slot) -> testCaseMain = NULL;
+	if (parentSlot == -1) {
+		procEntry(slot) -> parent = NULL;
+		procEntry(slot) -> firstChild = NULL;
+		procEntry(slot) -> lastChild = NULL; // TO MATCH TEST CASES
+		procEntry(slot) -> olderSibling = NULL;
+		procEntry(slot) -> youngerSibling = NULL;
 	} else {
-		procTable[slot].parent = &procTable[parentSlot];
-		procTable[slot].firstChild = NULL;
-		procTable[slot].lastChild = NULL; // TO MATCH TEST CASES
-		procTable[slot].youngerSibling = NULL;
-		if (procTable[slot].parent -> firstChild == NULL) {
-			procTable[slot].olderSibling = NULL;
-			procTable[slot].parent -> firstChild = &procTable[slot];
-			procTable[slot].parent -> lastChild = &procTable[slot];
+		procEntry(slot) -> parent = procEntry(parentSlot);
+		procEntry(slot) -> firstChild = NULL;
+		procEntry(slot) -> lastChild = NULL; // TO MATCH TEST CASES
+		procEntry(slot) -> youngerSibling = NULL;
+		if (procEntry(slot) -> parent -> firstChild == NULL) {
+			procEntry(slot) -> olderSibling = NULL;
+			procEntry(slot) -> parent -> firstChild = procEntry(slot);
+			procEntry(slot) -> parent -> lastChild = procEntry(slot);
 		} else {
-			procTable[slot].parent -> lastChild -> youngerSibling = &procTable[slot];
-			procTable[slot].olderSibling = procTable[slot].parent -> lastChild;
-			procTable[slot].parent -> lastChild = &procTable[slot];
+			procEntry(slot) -> parent -> lastChild -> youngerSibling = procEntry(slot);
+			procEntry(slot) -> olderSibling = procEntry(slot) -> parent -> lastChild;
+			procEntry(slot) -> parent -> lastChild = procEntry(slot);
 		}
 	}
-	procTable[slot].numChildren = 0;
-	if (PID != 1) procTable[slot].parent -> numChildren ++;
-	procTable[slot].state = READY;
-	procTable[slot].runnableStatus = 0;
-	procTable[slot].isZapped = 0;
-	procTable[slot].zappers = NULL;
-	procTable[slot].numZapped = 0;
+	procEntry(slot) -> numChildren = 0;
+	if (PID != 1) procEntry(slot) -> parent -> numChildren ++;
+	procEntry(slot) -> state = READY;
+	procEntry(slot) -> runnableStatus = 0;
+	procEntry(slot) -> isZapped = 0;
+	procEntry(slot) -> zappers = NULL;
+	procEntry(slot) -> numZapped = 0;
 	processTableCount++;
-	if (PID > 1) mmu_init_proc(procTable[slot].PID);
-	USLOSS_ContextInit(&(procTable[slot].context),
-						malloc(stacksize),
-						procTable[slot].stacksize,
-						procTable[slot].context.pageTable,
+	if (PID > 1) {
+		mmu_init_proc(procEntry(slot) -> PID);
+		forkHook(procEntry(slot) -> parent -> PID, PID);
+	}
+	coldEntry(slot) -> stack = allocateStack(stacksize, &coldEntry(slot) -> stackClass,
+												&coldEntry(slot) -> stackBytes);
+	USLOSS_ContextInit(&(coldEntry(slot) -> context),
+						coldEntry(slot) -> stack,
+						coldEntry(slot) -> stacksize,
+						coldEntry(slot) -> context.pageTable,
 						launcher);
 	// add to the ready process queue
 	enqueue(PID);
 }
 
+/*
+ * Called by part 5 from its init, hook runs for every new process after
+ * mmu_init_proc()
+ */
+void registerForkHook(void (*hook)(int, int)) { forkHook = hook; }
+
+/*
+ * The fork hook used until a phase installs its own
+ */
+void noForkHook(int parent, int child) {}
+
+/*
+ * Called by part 5 from its init, dumpProc() prints a paging stats table
+ * for every process hook returns 0 for
+ */
+void registerProcStatsHook(int (*hook)(int, int *, int *, int *, int *, int *)) {
+	procStatsHook = hook;
+}
+
+/*
+ * The paging stats hook used until a phase installs its own, no process
+ * has any
+ */
+int noProcStats(int pid, int *rss, int *major, int *minor, int *ref, int *dirty) {
+	return -1;
+}
+
 /*
  * Delete a dead process from the process table
  */
 void deleteProcess(int slot) {
-	PTE p = procTable[slot];
-	if (p.parent -> firstChild -> PID == p.PID) {
-		if (p.parent -> lastChild -> PID == p.PID) {
-			p.parent -> firstChild = NULL;
-			p.parent -> lastChild = NULL;
+	PTE *p = procEntry(slot);
+	if (p -> parent -> firstChild -> PID == p -> PID) {
+		if (p -> parent -> lastChild -> PID == p -> PID) {
+			p -> parent -> firstChild = NULL;
+			p -> parent -> lastChild = NULL;
 		} else {
-			p.parent -> firstChild = p.parent -> firstChild -> youngerSibling;
-			p.parent -> firstChild -> olderSibling = NULL;
+			p -> parent -> firstChild = p -> parent -> firstChild -> youngerSibling;
+			p -> parent -> firstChild -> olderSibling = NULL;
 		}
-	} else if (p.parent -> lastChild -> PID == p.PID) {
-		p.parent -> lastChild = p.olderSibling;
-		p.parent -> lastChild -> youngerSibling = NULL;
+	} else if (p -> parent -> lastChild -> PID == p -> PID) {
+		p -> parent -> lastChild = p -> olderSibling;
+		p -> parent -> lastChild -> youngerSibling = NULL;
 	} else {
-		if (p.youngerSibling != NULL) {
-			p.olderSibling -> youngerSibling = p.youngerSibling;
-			p.youngerSibling -> olderSibling = p.olderSibling;
+		if (p -> youngerSibling != NULL) {
+			p -> olderSibling -> youngerSibling = p -> youngerSibling;
+			p -> youngerSibling -> olderSibling = p -> olderSibling;
 		} else 
-			p.olderSibling -> youngerSibling = NULL;
+			p -> olderSibling -> youngerSibling = NULL;
 	}
-	procTable[slot].parent -> numChildren --;
-	if (procTable[slot].state == DEAD && procTable[slot].read) {
-		memset(&procTable[slot], 0, 1 * sizeof(PTE));
-		processTableCount--;
+	procEntry(slot) -> parent -> numChildren --;
+	if (procEntry(slot) -> state == DEAD && procEntry(slot) -> read) 
+		releaseSlot(slot);
+}
+
+/*
+ * Take the empty slot at the front of the free queue, O(1)
+ * Caller must make sure there is one
+ */
+int allocateSlot() {
+	int slot = freeSlots[freeSlotsHead];
+	freeSlotsHead = (freeSlotsHead + 1) % PROCTABLEMAX;
+	freeSlotsCount--;
+	return slot;
+}
+
+/*
+ * Clear a slot on the process table and put it at the back of the free queue
+ * Its generation moves on so the next process there gets a new PID, once
+ * the generations run out the slot is retired and fork() has one less
+ */
+void releaseSlot(int slot) {
+	// the stack only goes back to the pool, so this is safe even when the
+	// dispatcher is still running on it to switch away
+	PTECold *cold = coldEntry(slot);
+	if (cold -> stack != NULL) {
+		releaseStack(cold -> stack, cold -> stackClass, cold -> stackBytes);
+		cold -> stack = NULL;
+	}
+	// the rest of the cold half is rewritten by newProcess(), only the hot
+	// half needs to look empty
+	memset(procEntry(slot), 0, 1 * sizeof(PTE));
+	processTableCount--;
+	// the reserved slots are never handed out by fork()
+	if (slot > 0 && slot < FIRSTFREESLOT) return;
+	// going back to an earlier generation would hand out a PID a join(),
+	// zap() or wait may still hold, so the slot goes out of use instead
+	if (slotGeneration[slot] >= (0x7fffffff - slot) / PROCTABLEMAX) return;
+	slotGeneration[slot]++;
+	freeSlots[(freeSlotsHead + freeSlotsCount) % PROCTABLEMAX] = slot;
+	freeSlotsCount++;
+}
+
+/*
+ * Get a stack of at least stacksize bytes, from the pool if possible
+ * Sizes up to 16 * USLOSS_MIN_STACK are rounded up to a power of two class,
+ * larger ones share the last pool and are reused if big enough
+ * With STACKGUARD, stacks are mmap()ed, so pages are only committed when
+ * touched, and an unmapped guard region catches overflow
+ */
+void *allocateStack(int stacksize, int *stackClass, int *stackBytes) {
+	int size = USLOSS_MIN_STACK;
+	int class = 0;
+	while (size < stacksize && class < STACKCLASSES - 1) {
+		size *= 2;
+		class++;
+	}
+	if (class == STACKCLASSES - 1) size = stacksize;
+	*stackClass = class;
+	// first fit, every stack in the lower classes fits by construction
+	freeStack **prev = &stackPool[class];
+	for (freeStack *curr = stackPool[class]; curr != NULL; curr = curr -> next) {
+		if (curr -> size >= size) {
+			*prev = curr -> next;
+			*stackBytes = curr -> size;
+			return curr;
+		}
+		prev = &curr -> next;
+	}
+	freeStack *stack;
+#ifdef STACKGUARD
+	char *base = mmap(NULL, size + STACKGUARDSIZE, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED || mprotect(base, STACKGUARDSIZE, PROT_NONE) != 0) 
+		base = NULL;
+	stack = base == NULL ? NULL : (freeStack *)(base + STACKGUARDSIZE);
+#else
+	stack = malloc(size);
+#endif
+	if (stack == NULL) {
+		USLOSS_Trace("Error: Out of memory! \n");
+		USLOSS_Halt(1);
+	}
+	*stackBytes = size;
+	return stack;
+}
+
+/*
+ * Put a stack back in its pool under the size it was allocated with
+ * The size is written here, the process may have used every byte of it
+ */
+void releaseStack(void *stack, int stackClass, int stackBytes) {
+	freeStack *node = stack;
+	node -> size = stackBytes;
+	node -> next = stackPool[stackClass];
+	stackPool[stackClass] = node;
+}
+
+/*
+ * Return the entry of a slot, a slot past the end of the table reads as an
+ * empty entry so that a made-up PID names no process
+ */
+PTE *procEntry(int slot) {
+	static PTE noEntry;
+	if (slot < 0 || slot >= procTableSlots) return &noEntry;
+	return &procChunks[slot / PROCCHUNK][slot % PROCCHUNK];
+}
+
+/*
+ * Return the cold half of a process table entry
+ * Allocate its chunk if no slot in it has been used yet
+ */
+PTECold *coldEntry(int slot) {
+	PTECold *chunk = coldChunks[slot / PROCCHUNK];
+	if (chunk == NULL) {
+		chunk = calloc(PROCCHUNK, sizeof(PTECold));
+		if (chunk == NULL) {
+			USLOSS_Trace("Error: Out of memory! \n");
+			USLOSS_Halt(1);
+		}
+		coldChunks[slot / PROCCHUNK] = chunk;
+	}
+	return &chunk[slot % PROCCHUNK];
+}
+
+/*
+ * Add a chunk of empty slots to the table and to the back of the free queue
+ * Slot 0 joins with the last chunk, so that PIDs start out as small as they
+ * would in a table that never grows
+ * @return:		0, if the table already has PROCTABLEMAX slots
+ * 				1, otherwise
+ */
+int growTable() {
+	if (procTableSlots == PROCTABLEMAX) return 0;
+	PTE *chunk = calloc(PROCCHUNK, sizeof(PTE));
+	if (chunk == NULL) {
+		USLOSS_Trace("Error: Out of memory! \n");
+		USLOSS_Halt(1);
+	}
+	procChunks[procTableSlots / PROCCHUNK] = chunk;
+	for (int i = procTableSlots; i < procTableSlots + PROCCHUNK; i++) {
+		if (i < FIRSTFREESLOT) continue;
+		freeSlots[(freeSlotsHead + freeSlotsCount) % PROCTABLEMAX] = i;
+		freeSlotsCount++;
+	}
+	procTableSlots += PROCCHUNK;
+	if (procTableSlots == PROCTABLEMAX) {
+		freeSlots[(freeSlotsHead + freeSlotsCount) % PROCTABLEMAX] = 0;
+		freeSlotsCount++;
+	}
+	return 1;
+}
+
+/*
+ * Return the slot of a PID, the index every phase uses for its own
+ * per-process state
+ */
+int procSlot(int pid) {
+	return pid % PROCTABLEMAX;
+}
+
+/*
+ * Return how many slots the table has now, every slot a process can be in
+ * is below this
+ */
+int procTableSize() {
+	return procTableSlots;
+}
+
+/*
+ * Called by the other phases from their init for a table with one entry of
+ * size bytes per process, which grows with the process table
+ * @return:		the id to pass to procShadow()
+ */
+int procShadowRegister(int size) {
+	if (numShadows == MAXSHADOWS) {
+		USLOSS_Console("ERROR: all %d shadow tables are taken. ", MAXSHADOWS);
+		USLOSS_Console("Raise MAXSHADOWS in part1.c.\n");
+		USLOSS_Halt(1);
+	}
+	shadowSizes[numShadows] = size;
+	return numShadows++;
+}
+
+/*
+ * Return the entry of a shadow table for a PID, or for a slot since a slot
+ * is its own procSlot(). Entries start out zeroed, and stay as the phase
+ * left them when the slot is reused
+ */
+void *procShadow(int id, int pid) {
+	int slot = procSlot(pid);
+	char *chunk = shadowChunks[id][slot / PROCCHUNK];
+	if (chunk == NULL) {
+		chunk = calloc(PROCCHUNK, shadowSizes[id]);
+		if (chunk == NULL) {
+			USLOSS_Trace("Error: Out of memory! \n");
+			USLOSS_Halt(1);
+		}
+		shadowChunks[id][slot / PROCCHUNK] = chunk;
 	}
+	return chunk + slot % PROCCHUNK * shadowSizes[id];
 }
 
 /*
@@ -858,13 +1504,13 @@ void launcher() {
 	enableInterrupt();
 	// run the function
 	int re;
-	int slot = currProcess % MAXPROC;
-	if (strcmp(procTable[slot].name, "testcase_main") != 0)
-		re = procTable[slot].func(procTable[slot].arg);
+	int slot = procSlot(currProcess);
+	if (strcmp(coldEntry(slot) -> name, "testcase_main") != 0)
+		re = coldEntry(slot) -> func(coldEntry(slot) -> arg);
 	else
-		re = procTable[slot].testCaseMain();
+		re = coldEntry(slot) -> testCaseMain();
 	// if it's testcase_main
-	if (strcmp(procTable[slot].name, "testcase_main") == 0) {
+	if (strcmp(coldEntry(slot) -> name, "testcase_main") == 0) {
 		if (re != 0) {
 			USLOSS_Trace("Error: some error was detected by the testcase. ");
 			USLOSS_Trace("Return code is %d\n", re);
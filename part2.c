@@ -20,18 +20,52 @@
 #define INTSIZE		4	// in bytes
 #define NUMDEVICE	2
 #define NUMTERMINAL	4
+#define INTQUEUEDEPTH	8	// statuses a disk or terminal can queue for its driver
+#define MAXPOLL		16	// most mailboxes and devices one PollMbox() can watch
+// PollMbox() ids at or above MAXMBOX name a device instead of a mailbox
+#define POLLDEVICE(type, unit)	(MAXMBOX + (type) * 8 + (unit))
+// extra syscall, numbered down from the top of systemCallVec[] so it stays
+// clear of usyscall.h
+#define SYS_POLL	(MAXSYSCALLS - 3)
 /* ------------------------------------------------------------------------- */
 
 /* -------------------------------------------------------- Helper Functions */
+struct queue;
 int checkRelease(int MID);
 void diskInterruptHandler(int type, void *payload);
 void terminalInterruptHandler(int type, void *payload);
 void syscallInterruptHandler(int type, void *payload);
 static void nullsys(systemArgs *args);
-void checkKernelMode();
-void restoreInterrupt(int PSR);
-void disableInterrupt();
-void enableInterrupt();
+void pollsys(systemArgs *args);
+int pollTarget(int id);
+int pollReady(int id, int MID);
+void registerDevicePoll(int (*ready)(int type, int unit));
+int noDeviceReady(int type, int unit);
+void wakePollers(int MID);
+int mergeTerminalStatus(int MID, int status);
+int interruptSend(int MID, int *status);
+void queueAppend(struct queue **head, struct queue **tail, int ID);
+int queuePop(struct queue **head, struct queue **tail);
+int queueSlot(int MID, void *msg, int msgSize);
+int takeSlot(int MID, void *buffer, int bufSize);
+int takeFromProducer(int MID, void *buffer, int bufSize);
+void handToConsumer(int MID, void *msg, int msgSize);
+void refillFromProducer(int MID);
+int copyMessage(void *to, int toSize, void *from, int size);
+int waitHandOff(int MID, int reason);
+void wakeWaiter(int PID, int result);
+int mboxWaitingOn(int pid);
+static struct shadowPTE *shadowEntry(int pid);
+int procShadowRegister(int size);
+void *procShadow(int id, int pid);
+void registerWaitLookups(int (*mbox)(int), int (*sem)(int));
+int statRegister(char *name);
+void statRecord(int id, int value);
+int statStart();
+void statLatency(int id, int start);
+static void checkKernelMode();
+static void restoreInterrupt(int PSR);
+static void disableInterrupt();
 /* ------------------------------------------------------------------------- */
 
 /* -------------------------------------------------------------- Structures */
@@ -59,14 +93,20 @@ typedef struct mailbox {
 	struct queue *consumersTail; 
 	struct queue *producersHead;
 	struct queue *producersTail;
+	struct queue *pollers;	// processes in PollMbox() watching this mailbox
 } mailbox;
 
 typedef struct shadowPTE{
 	int PID;
-	int status;
 	int isBlocked;
+	int waitMbox;	// the mailbox this process is blocked on, if isBlocked
+	int isPolling;
+	// while blocked in Send or Receive: the message to send or the buffer to
+	// receive into, and its size
 	void *msg;
 	int msgSize;
+	int handedOff;	// set by whoever finished the transfer, before waking us
+	int result;		// what Send or Receive returns once handedOff
 } shadowPTE;
 /* ------------------------------------------------------------------------- */
 
@@ -76,8 +116,8 @@ void (*systemCallVec[MAXSYSCALLS])(systemArgs *args);
 mailbox mailboxes[MAXMBOX]; 
 // array of mail slots
 mailSlot mailSlots[MAXSLOTS];
-// shadow process table
-shadowPTE shadowProcTable[MAXPROC];
+// shadow process table, kept by part 1 so it grows with the process table
+static int shadowTable;
 int numMailboxes, numSlotUsed;
 int curMID, curSID;
 // count blocked process
@@ -87,6 +127,20 @@ int clockInterruptCount;
 int clockMB;
 int diskMB[NUMDEVICE];
 int terminalMB[NUMTERMINAL];
+// interrupts that found their mailbox full
+int clockDropped;
+int diskDropped[NUMDEVICE];
+int terminalDropped[NUMTERMINAL];
+// latency stats in microseconds, blocking time included
+int statSend0, statSendN, statRecv0, statRecvN, statIntSend;
+// times a blocked Send or Receive woke up with nothing done for it
+int statSpurious;
+// whether a disk or terminal has data for a reader, the drivers take every
+// interrupt status so only the phase that buffers the data can tell
+int (*deviceReadyHook)(int type, int unit) = noDeviceReady;
+// the counts above as stats, one sample per lost status so dumpStats()
+// shows them
+int statClockDropped, statDiskIntDropped, statTermIntDropped;
 /* ------------------------------------------------------------------------- */
 
 /* ------------------------------------------------------ Required Functions */
@@ -115,16 +169,30 @@ void part2_init(void) {
 	curSID = 0;
 	blockingIOCount = 0;
 	clockInterruptCount = 0;
+	clockDropped = 0;
+	memset(diskDropped, 0, NUMDEVICE * sizeof(int));
+	memset(terminalDropped, 0, NUMTERMINAL * sizeof(int));
+	statSend0 = statRegister("mbox_send_0slot_us");
+	statSendN = statRegister("mbox_send_nslot_us");
+	statRecv0 = statRegister("mbox_recv_0slot_us");
+	statRecvN = statRegister("mbox_recv_nslot_us");
+	statIntSend = statRegister("mbox_condsend_intr_us");
+	statSpurious = statRegister("mbox_spurious_wakeups");
+	statClockDropped = statRegister("clock_ticks_coalesced");
+	statDiskIntDropped = statRegister("disk_intr_dropped");
+	statTermIntDropped = statRegister("term_intr_dropped");
+	registerWaitLookups(mboxWaitingOn, NULL);
 	// initialize the arrays with all 0
 	memset(mailboxes, 0, MAXMBOX * sizeof(mailbox)); 
 	memset(mailSlots, 0, MAXSLOTS * sizeof(mailSlot));
-	memset(shadowProcTable, 0, MAXPROC * sizeof(shadowPTE));
-	// initialize interrupt mailboxes
+	shadowTable = procShadowRegister(sizeof(shadowPTE));
+	// initialize interrupt mailboxes, the clock only needs to know that time
+	// passed, the other devices queue every status for their driver
 	clockMB = CreateMbox(1, INTSIZE);
 	for (int i = 0; i < NUMDEVICE; i++) 
-		diskMB[i] = CreateMbox(1, INTSIZE);
+		diskMB[i] = CreateMbox(INTQUEUEDEPTH, INTSIZE);
 	for (int i = 0; i < NUMTERMINAL; i++)
-		terminalMB[i] = CreateMbox(1, INTSIZE);
+		terminalMB[i] = CreateMbox(INTQUEUEDEPTH, INTSIZE);
 	// install interrupt handler onto USLOSS_IntVet[]
 	USLOSS_IntVec[USLOSS_DISK_INT] = diskInterruptHandler;
 	USLOSS_IntVec[USLOSS_TERM_INT] = terminalInterruptHandler;
@@ -132,6 +200,7 @@ void part2_init(void) {
 	// initialize systemCallVec[]
 	for (int i = 0; i < MAXSYSCALLS; i++)
 		systemCallVec[i] = nullsys;
+	systemCallVec[SYS_POLL] = pollsys;
 }	
 
 /*
@@ -175,6 +244,7 @@ int CreateMbox(int numSlots, int slotSize) {
 	mailboxes[openMailbox].consumersTail = NULL;
 	mailboxes[openMailbox].producersHead = NULL;
 	mailboxes[openMailbox].producersTail = NULL;
+	mailboxes[openMailbox].pollers = NULL;
 	numMailboxes++;	
 	curMID++;
 	// restore interrupt
@@ -199,29 +269,46 @@ int ReleaseMbox(int mbox_id) {
 	}
 	// start releasing the mailbox
 	mailboxes[mbox_id].status = DESTROYED;
-	// release producers and consumers aka wake them all up
-	queue *curr = mailboxes[mbox_id].consumersHead;
-	for (; curr != NULL; curr = curr -> next) {
-		if (shadowProcTable[curr -> ID % MAXPROC].isBlocked) {
-			shadowProcTable[curr -> ID % MAXPROC].isBlocked = 0;
-			unblockProc(curr -> ID);
+	// every producer and consumer gets -3, they are woken once the mailbox
+	// is gone since one may run right away
+	queue *wakeHead = NULL, *wakeTail = NULL;
+	queue **waiters[2] = {&mailboxes[mbox_id].consumersHead, 
+							&mailboxes[mbox_id].producersHead};
+	for (int i = 0; i < 2; i++) {
+		while (*waiters[i] != NULL) {
+			queue *curr = *waiters[i];
+			*waiters[i] = curr -> next;
+			// a waiter that has not blocked yet sees the result and does not
+			shadowPTE *waiter = shadowEntry(curr -> ID);
+			waiter -> result = -3;
+			waiter -> handedOff = 1;
+			if (waiter -> isBlocked) {
+				waiter -> isBlocked = 0;
+				queueAppend(&wakeHead, &wakeTail, curr -> ID);
+			}
+			free(curr);
 		}
 	}
-	curr = mailboxes[mbox_id].producersHead;
-	for (; curr != NULL; curr = curr -> next) {
-		if (shadowProcTable[curr -> ID % MAXPROC].isBlocked) {
-			shadowProcTable[curr -> ID % MAXPROC].isBlocked = 0;
-			unblockProc(curr -> ID);
-		}
-	}
-	curr = mailboxes[mbox_id].slotsHead;
-	for (; curr != NULL; curr = curr -> next) {
+	queue *curr = mailboxes[mbox_id].slotsHead;
+	while (curr != NULL) {
+		queue *next = curr -> next;
+		free(mailSlots[curr -> ID].message);
 		memset(&mailSlots[curr -> ID], 0, 1 * sizeof(mailSlot));
 		numSlotUsed--;
+		free(curr);
+		curr = next;
+	}
+	// pollers see the release as ready and get -3 when they receive
+	wakePollers(mbox_id);
+	while (mailboxes[mbox_id].pollers != NULL) {
+		curr = mailboxes[mbox_id].pollers;
+		mailboxes[mbox_id].pollers = curr -> next;
+		free(curr);
 	}
 	// free this entry on the mailboxes array
 	memset(&mailboxes[mbox_id], 0, 1 * sizeof(mailbox));
 	numMailboxes--;
+	while (wakeHead != NULL) unblockProc(queuePop(&wakeHead, &wakeTail));
 	// restore interrupt
 	restoreInterrupt(currPSR);
 	return 0;
@@ -229,7 +316,8 @@ int ReleaseMbox(int mbox_id) {
 
 /*
  * Send message with the given mailbox
- * Enforce producer queue as well
+ * Producers are served in order, a producer that has to wait is only woken
+ * once a receiver took its message
  * @return:		-3, 	if the mailbox was released
  * 				-1, 	if invalid arguments
  * 				 0, 	success
@@ -239,6 +327,7 @@ int SendMbox(int mbox_id, void *msg_ptr, int msg_size) {
 	checkKernelMode();
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
+	int start = statStart();
 	// check for errors
 	if (mbox_id >= MAXMBOX || mbox_id < 0) {
 		restoreInterrupt(currPSR);
@@ -263,92 +352,34 @@ int SendMbox(int mbox_id, void *msg_ptr, int msg_size) {
 	}
 	// start to send message
 	mailbox *MB = &mailboxes[mbox_id];
-	// add this process to producer queue
-	queue *newProd = malloc(sizeof(queue));
-	newProd -> ID = getpid();
-	newProd -> next = NULL;
-	if (MB -> producersHead == NULL) {
-		MB -> producersHead = newProd;
-		MB -> producersTail = newProd;
-	} else {
-		MB -> producersTail -> next = newProd;
-		MB -> producersTail = MB -> producersTail -> next;
-	}
-	// block
-	while ((MB -> numSlots > 0 && MB -> numMsgQueued >= MB -> numSlots) 
-			|| (MB -> numSlots == 0 && MB -> consumersHead == NULL)
-			|| MB -> producersHead -> ID != getpid()) {
-		shadowProcTable[getpid() % MAXPROC].isBlocked = 1;
-		blockMe(15); // an arbitrary int 15
-		shadowProcTable[getpid() % MAXPROC].isBlocked = 0;
-		// if the mailbox was destroyed while blocked
-		if (mailboxes[mbox_id].status != OCCUPIED) {
-			restoreInterrupt(currPSR);
-			return -3;
-		}
-	}
-	// if has consumers and 0 message in slot, feed the message directly
-	if (MB -> consumersHead != NULL && MB -> numMsgQueued == 0) {
-		queue *curCons = MB -> consumersHead;
-		// feed the message into shadowPTE
-		if (msg_ptr == NULL) shadowProcTable[curCons -> ID % MAXPROC].msg = NULL;
-		else strcpy(shadowProcTable[curCons -> ID % MAXPROC].msg, msg_ptr);
-		shadowProcTable[curCons -> ID % MAXPROC].msgSize = msg_size;
-		// remove itself from the producer queue
-		MB -> producersHead = MB -> producersHead -> next;
-		if (MB -> producersHead == NULL) MB -> producersTail = NULL;
-		// remove the consumer queue
-		MB -> consumersHead = MB -> consumersHead -> next;
-		if (MB -> consumersHead == NULL) MB -> consumersTail = NULL;
-		// wake up the consumer
-		if (shadowProcTable[curCons -> ID].isBlocked) {
-			shadowProcTable[curCons -> ID].isBlocked = 0;
-			unblockProc(curCons -> ID);
-		}
-	// queue if has slots but not full
-	// or no consumers with available slots
-	} else if ((MB -> consumersHead == NULL && MB -> numMsgQueued == 0 
-					&& MB -> numSlots != 0)
-					|| MB -> numMsgQueued < MB -> numSlots) {
+	// a waiting consumer means no message is queued, give it ours
+	if (MB -> producersHead == NULL && MB -> consumersHead != NULL) 
+		handToConsumer(mbox_id, msg_ptr, msg_size);
+	else if (MB -> producersHead == NULL && MB -> numMsgQueued < MB -> numSlots) {
 		// halt simulation if all system mail slots are in use
-		if (numSlotUsed >= MAXSLOTS) {
+		if (queueSlot(mbox_id, msg_ptr, msg_size) == -2) {
 			USLOSS_Console("Error: all available system mail slots ");
 			USLOSS_Console("are in use, halt simulation\n");
 			USLOSS_Halt(1);
 		}
-		// create new slot queue object
-		queue *newSlot = malloc(sizeof(queue));
-		int openSlot = 0;
-		for (int i = curSID; ; i++) {
-			openSlot = i % MAXSLOTS;
-			if (mailSlots[openSlot].status == EMPTY) break;
-		}
-		newSlot -> ID = openSlot;
-		newSlot -> next = NULL;
-		mailSlots[openSlot].SID = openSlot;
-		mailSlots[openSlot].status = OCCUPIED;
-		mailSlots[openSlot].slotSize = msg_size;
-		if (msg_ptr == NULL) mailSlots[openSlot].message = NULL;
-		else {
-			mailSlots[openSlot].message = malloc(msg_size);
-			strcpy(mailSlots[openSlot].message, msg_ptr);
-		}
-		numSlotUsed++;
-		if (MB -> slotsHead == NULL) {
-			MB -> slotsHead = newSlot;
-			MB -> slotsTail = newSlot;
-		} else {
-			MB -> slotsTail -> next = newSlot;
-			MB -> slotsTail = MB -> slotsTail -> next;
-		}
-		MB -> numMsgQueued++;
-		// remove itself from the producer queue
-		MB -> producersHead = MB -> producersHead -> next;
-		if (MB -> producersHead == NULL) MB -> producersTail = NULL;
 	} else {
-		USLOSS_Console("DEBUG ERROR IN SendMbox()\n");
-		USLOSS_Halt(1);
+		// wait for a receiver to take the message straight from msg_ptr
+		shadowPTE *self = shadowEntry(getpid());
+		self -> PID = getpid();
+		self -> msg = msg_ptr;
+		self -> msgSize = msg_size;
+		self -> handedOff = 0;
+		queueAppend(&MB -> producersHead, &MB -> producersTail, getpid());
+		// a waiting producer makes a zero slot mailbox ready to receive, a
+		// poller may run and take the message before we get to block, which
+		// waitHandOff() then sees
+		if (MB -> numSlots == 0) wakePollers(mbox_id);
+		if (waitHandOff(mbox_id, 15) == -3) { // an arbitrary int 15
+			restoreInterrupt(currPSR);
+			return -3;
+		}
 	}
+	statLatency(MB -> numSlots == 0 ? statSend0 : statSendN, start);
 	// restore interrupt
 	restoreInterrupt(currPSR);
 	return 0;
@@ -356,6 +387,8 @@ int SendMbox(int mbox_id, void *msg_ptr, int msg_size) {
 
 /*
  * Receive Message
+ * Consumers are served in order, a consumer that has to wait is only woken
+ * once a producer put a message in its buffer
  * @return:		-3, 	if the mailbox was released
  * 				-1, 	if invalid arguments
  * 			   >=0, 	the size of the message received
@@ -365,6 +398,7 @@ int ReceiveMbox(int mbox_id, void *msg_ptr, int msg_max_size) {
 	checkKernelMode();
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
+	int start = statStart();
 	// check for errors
 	if (mbox_id >= MAXMBOX || mbox_id < 0 || msg_max_size < 0) {
 		restoreInterrupt(currPSR);
@@ -381,93 +415,29 @@ int ReceiveMbox(int mbox_id, void *msg_ptr, int msg_max_size) {
 			return -3;
 		}
 	} 
-
 	// start receiving
 	mailbox *MB = &mailboxes[mbox_id];
-	// add itself to the consumer queue
-	queue *newCons = malloc(sizeof(queue));
-	newCons -> ID = getpid();
-	newCons -> next = NULL;
-	if (MB -> consumersHead == NULL) {
-		MB -> consumersHead = newCons;
-		MB -> consumersTail = newCons;
-	} else {
-		MB -> consumersTail -> next = newCons;
-		MB -> consumersTail = MB -> consumersTail -> next;
-	}
-	int index = getpid() % MAXPROC;
-	shadowProcTable[index].status = OCCUPIED;
-	shadowProcTable[index].PID = getpid();
-	shadowProcTable[index].msg = malloc(msg_max_size);
-	shadowProcTable[index].msgSize = -1;
-	// block if no queued message or this process is not the first in consumer 
-	// queue, or no message has been feed yet
-	while (MB -> slotsHead == NULL || MB -> consumersHead -> ID != getpid()) {
-		// if zero slot mailbox and exist producers
-		if (MB -> numSlots == 0 && MB -> producersHead != NULL) {
-			shadowProcTable[MB -> producersHead -> ID % MAXPROC].isBlocked = 0;
-			unblockProc(MB -> producersHead -> ID);
-			break;
-		}
-		// otherwise block
-		shadowProcTable[getpid() % MAXPROC].isBlocked = 1;
-		blockMe(16); // an arbitrary int 16
-		shadowProcTable[getpid() % MAXPROC].isBlocked = 0;
-		// if message was feed directly
-		if (shadowProcTable[index].msgSize != -1) break;
-		// if the mailbox was destroyed while blocked
-		if (mailboxes[mbox_id].status != OCCUPIED) {
+	int msgSize;
+	if (MB -> consumersHead == NULL && MB -> slotsHead != NULL) {
+		msgSize = takeSlot(mbox_id, msg_ptr, msg_max_size);
+		refillFromProducer(mbox_id);
+	} else if (MB -> consumersHead == NULL && MB -> producersHead != NULL) 
+		msgSize = takeFromProducer(mbox_id, msg_ptr, msg_max_size);
+	else {
+		// wait for a producer to put the message straight into msg_ptr
+		shadowPTE *self = shadowEntry(getpid());
+		self -> PID = getpid();
+		self -> msg = msg_ptr;
+		self -> msgSize = msg_max_size;
+		self -> handedOff = 0;
+		queueAppend(&MB -> consumersHead, &MB -> consumersTail, getpid());
+		msgSize = waitHandOff(mbox_id, 16); // an arbitrary int 16
+		if (msgSize == -3) {
 			restoreInterrupt(currPSR);
 			return -3;
 		}
 	}
-	// If the message is not feed yet
-	if (shadowProcTable[index].msgSize == -1) {
-		int SID = MB -> slotsHead -> ID;
-		// remove the message from the mailbox
-		MB -> slotsHead = MB -> slotsHead -> next;
-		if (MB -> slotsHead == NULL) MB -> slotsTail = NULL;
-		MB -> numMsgQueued--;
-		// put the message in the shadowPTE
-		shadowProcTable[index].msg = mailSlots[SID].message;
-		shadowProcTable[index].msgSize = mailSlots[SID].slotSize;
-		// remove the slot from the mailSlots array
-		memset(&mailSlots[SID], 0, 1 * sizeof(mailSlot));
-		numSlotUsed--;
-		curSID = SID;
-		// remove itself from the consumer queue
-		MB -> consumersHead = MB -> consumersHead -> next;
-		if (MB -> consumersHead == NULL) MB -> consumersTail = NULL;
-	} 
-	// write the message to the out pointer
-	if (shadowProcTable[index].msgSize > msg_max_size) {
-		restoreInterrupt(currPSR);
-		return -1;
-	}
-	int msgSize = shadowProcTable[index].msgSize;
-	if (msgSize != 0 && msg_ptr == NULL) {
-		USLOSS_Console("Error: receive with NULL out pointer but non-zero message\n");
-		return -1;
-	}
-	if (shadowProcTable[index].msg == NULL || msg_ptr == NULL) 
-		msg_ptr = NULL;
-	else strcpy(msg_ptr, shadowProcTable[index].msg);
-	// free the spot on the shadow process table
-	memset(&shadowProcTable[index], 0, 1 * sizeof(shadowPTE));
-	// wake up the next producer if available slots
-	if (MB -> producersHead != NULL && MB -> numMsgQueued < MB -> numSlots) {
-		if (shadowProcTable[MB -> producersHead -> ID % MAXPROC].isBlocked) {
-			shadowProcTable[MB -> producersHead -> ID % MAXPROC].isBlocked = 0;
-			unblockProc(MB -> producersHead -> ID);
-		}
-	}
-	// wake up the next consumer if more messages in slots
-	if (MB -> consumersHead != NULL && MB -> slotsHead != NULL) {
-		if (shadowProcTable[MB -> consumersHead -> ID % MAXPROC].isBlocked) {
-			shadowProcTable[MB -> consumersHead -> ID % MAXPROC].isBlocked = 0;
-			unblockProc(MB -> consumersHead -> ID);
-		}
-	}
+	statLatency(MB -> numSlots == 0 ? statRecv0 : statRecvN, start);
 	// restore interrupt
 	restoreInterrupt(currPSR);
 	return msgSize;
@@ -504,70 +474,17 @@ int CondSendMbox(int mbox_id, void *msg_ptr, int msg_size) {
 	}
 	// start to send message
 	mailbox *MB = &mailboxes[mbox_id];
+	int re = 0;
 	// return -2 if the producer queue is not empty
-	if (MB -> producersHead != NULL) {
-		restoreInterrupt(currPSR);
-		return -2;
-	}
-	// if has consumers and 0 message in slot, feed the message directly
-	if (MB -> consumersHead != NULL && MB -> numMsgQueued == 0) {
-		queue *curCons = MB -> consumersHead;
-		// feed the message into shadowPTE
-		if (msg_ptr == NULL) shadowProcTable[curCons -> ID].msg = NULL;
-		else {
-			shadowProcTable[curCons -> ID].msg = malloc(msg_size);
-			strcpy(shadowProcTable[curCons -> ID % MAXPROC].msg, msg_ptr);
-		}
-		shadowProcTable[curCons -> ID % MAXPROC].msgSize = msg_size;
-		unblockProc(curCons -> ID);
-	// queue if has slots but not full
-	// or no consumers with available slots
-	} else if ((MB -> consumersHead == NULL && MB -> numMsgQueued == 0 
-					&& MB -> numSlots != 0)
-					|| MB -> numMsgQueued < MB -> numSlots) {
-		// halt simulation if all system mail slots are in use
-		if (numSlotUsed >= MAXSLOTS) {
-			// USLOSS_Console("Error: all available system mail slots ");
-			// USLOSS_Console("are in use, halt simulation\n");
-			// USLOSS_Halt(1);
-			// change to match testcase 16 exactly
-			restoreInterrupt(currPSR);
-			return -2;
-		}
-		queue *newSlot = malloc(sizeof(queue));
-		int openSlot = 0;
-		for (int i = curSID; ; i++) {
-			openSlot = i % MAXSLOTS;
-			if (mailSlots[openSlot].status == EMPTY) break;
-		}
-		newSlot -> ID = openSlot;
-		newSlot -> next = NULL;
-		
-		mailSlots[openSlot].SID = openSlot;
-		mailSlots[openSlot].status = OCCUPIED;
-		mailSlots[openSlot].slotSize = msg_size;
-		if (msg_ptr == NULL) mailSlots[openSlot].message = NULL;
-		else {
-			mailSlots[openSlot].message = malloc(msg_size);
-			strcpy(mailSlots[openSlot].message, msg_ptr);
-		}
-		numSlotUsed++;
-		if (MB -> slotsHead == NULL) {
-			MB -> slotsHead = newSlot;
-			MB -> slotsTail = newSlot;
-		} else {
-			MB -> slotsTail -> next = newSlot;
-			MB -> slotsTail = MB -> slotsTail -> next;
-		}
-		MB -> numMsgQueued++;
+	if (MB -> producersHead != NULL) re = -2;
+	else if (MB -> consumersHead != NULL) handToConsumer(mbox_id, msg_ptr, msg_size);
+	// -2 when all system mail slots are in use, to match testcase 16 exactly
+	else if (MB -> numMsgQueued < MB -> numSlots) re = queueSlot(mbox_id, msg_ptr, msg_size);
 	// else it'll attempt to block so return -2
-	} else {
-		restoreInterrupt(currPSR);
-		return -2;
-	}
+	else re = -2;
 	// restore interrupt
 	restoreInterrupt(currPSR);
-	return 0;
+	return re;
 }
 
 /*
@@ -595,51 +512,89 @@ int CondReceiveMbox(int mbox_id, void *msg_ptr, int msg_max_size) {
 	}
 	// start receiving
 	mailbox *MB = &mailboxes[mbox_id];
-	int index = getpid() % MAXPROC;
-	// read if no consumer but has slots
+	int msgSize = -2;
 	if (MB -> consumersHead == NULL && MB -> slotsHead != NULL) {
-		int SID = MB -> slotsHead -> ID;
-		// remove the message from the mailbox
-		MB -> slotsHead = MB -> slotsHead -> next;
-		if (MB -> slotsHead == NULL) MB -> slotsTail = NULL;
-		MB -> numMsgQueued--;
-		// put the message in the shadowPTE
-		shadowProcTable[index].PID = getpid();
-		if (mailSlots[SID].message == NULL) shadowProcTable[index].msg = NULL;
-		else {
-			shadowProcTable[index].msg = malloc(mailSlots[SID].slotSize);
-			strcpy(shadowProcTable[index].msg, mailSlots[SID].message);
-		}
-		shadowProcTable[index].msgSize = mailSlots[SID].slotSize;
-		// remove the slot from the mailSlots array
-		memset(&mailSlots[SID], 0, 1 * sizeof(mailSlot));
-		numSlotUsed--;
-		curSID = SID;
-	} else {
-		restoreInterrupt(currPSR);
-		return -2;
-	}
-	// write the message to the out pointer
-	if (shadowProcTable[index].msgSize > msg_max_size) {
-		restoreInterrupt(currPSR);
-		return -1;
-	}
-	int msgSize = shadowProcTable[index].msgSize;
-	if (shadowProcTable[index].msg == NULL) msg_ptr = NULL;
-	else strcpy(msg_ptr, shadowProcTable[index].msg);
-	// free the spot on the shadow process table
-	memset(&shadowProcTable[index], 0, 1 * sizeof(shadowPTE));
-	// wake up the next producer if avaliable slots
-	if (MB -> producersHead != NULL && MB -> numMsgQueued < MB -> numSlots)
-		unblockProc(MB -> producersHead -> ID);
-	// wake up the next consumer if more messages in slots
-	if (MB -> consumersHead != NULL && MB -> slotsHead != NULL) 
-		unblockProc(MB -> consumersHead -> ID);
+		msgSize = takeSlot(mbox_id, msg_ptr, msg_max_size);
+		refillFromProducer(mbox_id);
+	} else if (MB -> consumersHead == NULL && MB -> producersHead != NULL) 
+		msgSize = takeFromProducer(mbox_id, msg_ptr, msg_max_size);
 	// restore interrupt
 	restoreInterrupt(currPSR);
 	return msgSize;
 }
 
+/*
+ * Wait until at least one of the given mailboxes or devices is ready
+ * An id below MAXMBOX is a mailbox, POLLDEVICE(type, unit) is a disk or 
+ * terminal. A mailbox is ready if a ReceiveMbox() on it would not block, or
+ * it was released. A device is ready when the hook installed with
+ * registerDevicePoll() says so, without one when an interrupt status is
+ * queued that no driver took
+ * @parameters:	ids, 		the mailboxes and devices to watch
+ * 				count, 		number of entries in ids, at most MAXPOLL
+ * 				ready, 		out array, ready[i] is set to 1 if ids[i] is ready
+ * @return:		-1, 		if invalid arguments
+ * 				>0, 		the number of ready entries
+ */
+int PollMbox(int *ids, int count, int *ready) {
+	// check kernel mode and disable interrupt
+	checkKernelMode();
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	// check for errors
+	int MIDs[MAXPOLL];
+	int hasDevice = 0;
+	if (ids == NULL || ready == NULL || count <= 0 || count > MAXPOLL) {
+		restoreInterrupt(currPSR);
+		return -1;
+	}
+	for (int i = 0; i < count; i++) {
+		MIDs[i] = pollTarget(ids[i]);
+		if (MIDs[i] == -1) {
+			restoreInterrupt(currPSR);
+			return -1;
+		}
+		if (ids[i] >= MAXMBOX) hasDevice = 1;
+	}
+	shadowPTE *self = shadowEntry(getpid());
+	while (1) {
+		int numReady = 0;
+		for (int i = 0; i < count; i++) {
+			ready[i] = pollReady(ids[i], MIDs[i]);
+			numReady += ready[i];
+		}
+		if (numReady > 0) {
+			restoreInterrupt(currPSR);
+			return numReady;
+		}
+		// watch every mailbox in the set
+		for (int i = 0; i < count; i++) {
+			queue *newPoller = malloc(sizeof(queue));
+			newPoller -> ID = getpid();
+			newPoller -> next = mailboxes[MIDs[i]].pollers;
+			mailboxes[MIDs[i]].pollers = newPoller;
+		}
+		// block, waiting on a device counts as I/O for the sentinel
+		if (hasDevice) blockingIOCount++;
+		self -> isPolling = 1;
+		blockMe(17); // an arbitrary int 17
+		self -> isPolling = 0;
+		if (hasDevice) blockingIOCount--;
+		// stop watching, then check again which ones are ready
+		for (int i = 0; i < count; i++) {
+			queue **curr = &mailboxes[MIDs[i]].pollers;
+			for (; *curr != NULL; curr = &(*curr) -> next) {
+				if ((*curr) -> ID == getpid()) {
+					queue *temp = *curr;
+					*curr = temp -> next;
+					free(temp);
+					break;
+				}
+			}
+		}
+	}
+}
+
 /*
  * Waits for an interrupt to fire on a given device
  * @return:		0, 		always
@@ -679,6 +634,61 @@ int deviceWait(int type, int unit, int *status) {
 	return 0;
 }
 
+/*
+ * Take a pending interrupt status from a device without blocking
+ * Drivers call this after deviceWait() to drain everything that queued up
+ * @return:		-2, 	if no status is pending
+ * 				 0, 	otherwise
+ */
+int condDeviceWait(int type, int unit, int *status) {
+	// check kernel mode and disable interrupt
+	checkKernelMode();
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	int re = -2;
+	if (type == USLOSS_CLOCK_INT && unit == 0) 
+		re = CondReceiveMbox(clockMB, status, INTSIZE);
+	else if (type == USLOSS_DISK_INT && unit >= 0 && unit < NUMDEVICE) 
+		re = CondReceiveMbox(diskMB[unit], status, INTSIZE);
+	else if (type == USLOSS_TERM_INT && unit >= 0 && unit < NUMTERMINAL) 
+		re = CondReceiveMbox(terminalMB[unit], status, INTSIZE);
+	else {
+		USLOSS_Console("Error: invalid device type or unit, halt simulation\n");
+		USLOSS_Halt(1);
+	}
+	// restore interrupt
+	restoreInterrupt(currPSR);
+	return re < 0 ? -2 : 0;
+}
+
+/*
+ * Return how many interrupts from a device were lost because its driver
+ * fell behind; for the clock these are coalesced ticks, not lost data
+ */
+int deviceDropped(int type, int unit) {
+	checkKernelMode();
+	if (type == USLOSS_CLOCK_INT) return clockDropped;
+	else if (type == USLOSS_DISK_INT) return diskDropped[unit];
+	else if (type == USLOSS_TERM_INT) return terminalDropped[unit];
+	return 0;
+}
+
+/*
+ * Return the mailbox a process is blocked on in Send or Receive, -1 if none
+ * Used by the sentinel to report what a deadlocked process waits for
+ */
+int mboxWaitingOn(int pid) {
+	if (! shadowEntry(pid) -> isBlocked) return -1;
+	return shadowEntry(pid) -> waitMbox;
+}
+
+/*
+ * Return the shadow process table entry of a process
+ */
+static shadowPTE *shadowEntry(int pid) {
+	return procShadow(shadowTable, pid);
+}
+
 /*
  * Check the number of blocking process in the deviceWait
  * Return 0 is has noting, otherwise return the number blocked inside deviceWait()
@@ -689,7 +699,7 @@ int part2_check_io() {
 	int currPSR = USLOSS_PsrGet();
 	disableInterrupt();
 	// checking io
-	int retVal;
+	int retVal = 0;
 	if (blockingIOCount == 0) 
 		retVal = 0;
 	else if (blockingIOCount < 0) {
@@ -720,7 +730,11 @@ void part2_clockHandler() {
 			USLOSS_Console("Error: fail USLOSS_DeviceInput, halt simulation\n");
 			USLOSS_Halt(1);
 		}
-		CondSendMbox(clockMB, &status, INTSIZE);
+		// the driver has not seen the last tick yet, it will see this one with it
+		if (interruptSend(clockMB, &status) == -2) {
+			clockDropped++;
+			statRecord(statClockDropped, 1);
+		}
 		clockInterruptCount = 0;
 	}
 	// restore interrupt
@@ -736,17 +750,96 @@ void part2_clockHandler() {
 int checkRelease(int MID) {
 	queue *curr = mailboxes[MID].producersHead; 
 	for (; curr != NULL; curr = curr -> next) {
-		if (shadowProcTable[curr -> ID % MAXPROC].isBlocked) 
+		if (shadowEntry(curr -> ID) -> isBlocked) 
 			return 1;
 	}
 	curr = mailboxes[MID].consumersHead;
 	for (; curr != NULL; curr = curr -> next) {
-		if (shadowProcTable[curr -> ID % MAXPROC].isBlocked)
+		if (shadowEntry(curr -> ID) -> isBlocked)
 			return 1;
 	}
 	return 0;
 }
 
+/*
+ * Turn a PollMbox() id into the mailbox that backs it
+ * return -1 if it names no mailbox in use or no device
+ */
+int pollTarget(int id) {
+	if (id >= 0 && id < MAXMBOX) {
+		if (mailboxes[id].status == EMPTY) return -1;
+		return id;
+	}
+	// the clock has no data to wait for, SYS_SLEEP or a timed read is for that
+	for (int unit = 0; unit < NUMTERMINAL; unit++) {
+		if (id == POLLDEVICE(USLOSS_DISK_INT, unit) && unit < NUMDEVICE) return diskMB[unit];
+		if (id == POLLDEVICE(USLOSS_TERM_INT, unit)) return terminalMB[unit];
+	}
+	return -1;
+}
+
+/*
+ * Check whether a receive on the given mailbox would go through right away,
+ * or for a device id, whether the device has data for a reader
+ * return 1 if ready or released, 0 if otherwise
+ */
+int pollReady(int id, int MID) {
+	if (id >= MAXMBOX) {
+		int ready = deviceReadyHook((id - MAXMBOX) / 8, (id - MAXMBOX) % 8);
+		if (ready != -1) return ready;
+	}
+	mailbox *MB = &mailboxes[MID];
+	if (MB -> status != OCCUPIED) return 1;
+	if (MB -> consumersHead != NULL) return 0;
+	if (MB -> slotsHead != NULL) return 1;
+	return MB -> numSlots == 0 && MB -> producersHead != NULL;
+}
+
+/*
+ * Called by part 4 from its init, ready(type, unit) returns 1 if a disk or
+ * terminal has data for a reader, 0 if not, -1 to fall back on its
+ * interrupt statuses. The driver then calls deviceDataReady() whenever 
+ * the answer may have turned to 1
+ */
+void registerDevicePoll(int (*ready)(int type, int unit)) {
+	deviceReadyHook = ready;
+}
+
+/*
+ * The device poll hook used until a phase installs its own
+ */
+int noDeviceReady(int type, int unit) { return -1; }
+
+/*
+ * Called by a driver once a device has new data for a reader, wakes the
+ * processes polling it so they can check again
+ */
+void deviceDataReady(int type, int unit) {
+	checkKernelMode();
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	int MID = pollTarget(POLLDEVICE(type, unit));
+	if (MID != -1) wakePollers(MID);
+	restoreInterrupt(currPSR);
+}
+
+/*
+ * Wake up every process in PollMbox() that watches the given mailbox
+ * The pollers take themselves off the list once they run
+ */
+void wakePollers(int MID) {
+	queue *wakeHead = NULL, *wakeTail = NULL;
+	queue *curr = mailboxes[MID].pollers;
+	for (; curr != NULL; curr = curr -> next) {
+		if (shadowEntry(curr -> ID) -> isPolling) {
+			shadowEntry(curr -> ID) -> isPolling = 0;
+			queueAppend(&wakeHead, &wakeTail, curr -> ID);
+		}
+	}
+	// unblock only after the walk, a poller may run and edit the list
+	while (wakeHead != NULL) unblockProc(queuePop(&wakeHead, &wakeTail));
+}
+
 /*
  * Disk Interrupt Handler, type can be ignored cause it must be disk
  */
@@ -763,7 +856,11 @@ void diskInterruptHandler(int type, void *payload) {
 		USLOSS_Console("Error: fail USLOSS_DeviceInput, halt simulation\n");
 		USLOSS_Halt(1);
 	}
-	CondSendMbox(diskMB[unitNo], &status, INTSIZE);
+	if (interruptSend(diskMB[unitNo], &status) == -2) {
+		diskDropped[unitNo]++;
+		statRecord(statDiskIntDropped, 1);
+		USLOSS_Trace("Disk %d interrupt queue full, status dropped\n", unitNo);
+	}
 	// restore interrupt
 	restoreInterrupt(currPSR);
 }
@@ -784,11 +881,199 @@ void terminalInterruptHandler(int type, void *payload) {
 		USLOSS_Console("Error: fail USLOSS_DeviceInput, halt simulation\n");
 		USLOSS_Halt(1);
 	}
-	CondSendMbox(terminalMB[unitNo], &status, INTSIZE);
+	if (interruptSend(terminalMB[unitNo], &status) == -2
+			&& ! mergeTerminalStatus(terminalMB[unitNo], status)) {
+		terminalDropped[unitNo]++;
+		statRecord(statTermIntDropped, 1);
+	}
 	// restore interrupt
 	restoreInterrupt(currPSR);
 }
 
+/*
+ * Hand a device status to its driver from an interrupt handler, timed
+ */
+int interruptSend(int MID, int *status) {
+	int start = statStart();
+	int re = CondSendMbox(MID, status, INTSIZE);
+	statLatency(statIntSend, start);
+	return re;
+}
+
+/*
+ * Fold a terminal status into the newest one queued when the queue is full
+ * The transmit bits are a state, so the newer ones simply win; a received
+ * character can only be kept if the queued status does not carry one
+ * return 1 if merged, 0 if the status has to be dropped
+ */
+int mergeTerminalStatus(int MID, int status) {
+	if (mailboxes[MID].slotsTail == NULL) return 0;
+	int *queued = mailSlots[mailboxes[MID].slotsTail -> ID].message;
+	// the bits USLOSS_TERM_STAT_XMIT() reads, whatever they are
+	unsigned int xmitMask = 0;
+	for (int bit = 0; bit < 8 * (int) sizeof(int); bit++) 
+		if (USLOSS_TERM_STAT_XMIT((int)(1u << bit)) != 0) xmitMask |= 1u << bit;
+	if (USLOSS_TERM_STAT_RECV(*queued) != USLOSS_DEV_BUSY) {
+		*queued = status;
+		return 1;
+	} else if (USLOSS_TERM_STAT_RECV(status) != USLOSS_DEV_BUSY) {
+		*queued = (*queued & ~xmitMask) | (status & xmitMask);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Add a process or slot to the end of a queue
+ */
+void queueAppend(queue **head, queue **tail, int ID) {
+	queue *node = malloc(sizeof(queue));
+	node -> ID = ID;
+	node -> next = NULL;
+	if (*head == NULL) *head = node;
+	else (*tail) -> next = node;
+	*tail = node;
+}
+
+/*
+ * Remove the head of a non empty queue and return its ID
+ */
+int queuePop(queue **head, queue **tail) {
+	queue *node = *head;
+	int ID = node -> ID;
+	*head = node -> next;
+	if (*head == NULL) *tail = NULL;
+	free(node);
+	return ID;
+}
+
+/*
+ * Copy a message into a mail slot at the end of the mailbox
+ * return -2 if all system mail slots are in use, 0 otherwise
+ */
+int queueSlot(int MID, void *msg, int msgSize) {
+	mailbox *MB = &mailboxes[MID];
+	if (numSlotUsed >= MAXSLOTS) return -2;
+	int openSlot = 0;
+	for (int i = curSID; ; i++) {
+		openSlot = i % MAXSLOTS;
+		if (mailSlots[openSlot].status == EMPTY) break;
+	}
+	mailSlots[openSlot].SID = openSlot;
+	mailSlots[openSlot].status = OCCUPIED;
+	mailSlots[openSlot].slotSize = msgSize;
+	if (msgSize == 0) mailSlots[openSlot].message = NULL;
+	else {
+		mailSlots[openSlot].message = malloc(msgSize);
+		memcpy(mailSlots[openSlot].message, msg, msgSize);
+	}
+	numSlotUsed++;
+	queueAppend(&MB -> slotsHead, &MB -> slotsTail, openSlot);
+	MB -> numMsgQueued++;
+	wakePollers(MID);
+	return 0;
+}
+
+/*
+ * Take the first queued message of a mailbox into buffer
+ * The message is used up even if it does not fit
+ * return -1 if it does not fit, its size otherwise
+ */
+int takeSlot(int MID, void *buffer, int bufSize) {
+	mailbox *MB = &mailboxes[MID];
+	int SID = queuePop(&MB -> slotsHead, &MB -> slotsTail);
+	MB -> numMsgQueued--;
+	int re = copyMessage(buffer, bufSize, mailSlots[SID].message, mailSlots[SID].slotSize);
+	free(mailSlots[SID].message);
+	memset(&mailSlots[SID], 0, 1 * sizeof(mailSlot));
+	numSlotUsed--;
+	curSID = SID;
+	return re;
+}
+
+/*
+ * Take the message of the first blocked producer of a zero slot mailbox
+ * into buffer, and let the producer go
+ * return -1 if it does not fit, its size otherwise
+ */
+int takeFromProducer(int MID, void *buffer, int bufSize) {
+	mailbox *MB = &mailboxes[MID];
+	int PID = queuePop(&MB -> producersHead, &MB -> producersTail);
+	shadowPTE *producer = shadowEntry(PID);
+	int re = copyMessage(buffer, bufSize, producer -> msg, producer -> msgSize);
+	wakeWaiter(PID, 0);
+	return re;
+}
+
+/*
+ * Put a message in the buffer of the first blocked consumer, and let it go
+ */
+void handToConsumer(int MID, void *msg, int msgSize) {
+	mailbox *MB = &mailboxes[MID];
+	int PID = queuePop(&MB -> consumersHead, &MB -> consumersTail);
+	shadowPTE *consumer = shadowEntry(PID);
+	wakeWaiter(PID, copyMessage(consumer -> msg, consumer -> msgSize, msg, msgSize));
+}
+
+/*
+ * A slot was freed, queue the message of the first blocked producer in it
+ * and let the producer go
+ */
+void refillFromProducer(int MID) {
+	mailbox *MB = &mailboxes[MID];
+	if (MB -> producersHead == NULL || MB -> numMsgQueued >= MB -> numSlots) return;
+	int PID = queuePop(&MB -> producersHead, &MB -> producersTail);
+	shadowPTE *producer = shadowEntry(PID);
+	queueSlot(MID, producer -> msg, producer -> msgSize);
+	wakeWaiter(PID, 0);
+}
+
+/*
+ * Copy a message into a buffer of toSize bytes
+ * return -1 if it does not fit, its size otherwise
+ */
+int copyMessage(void *to, int toSize, void *from, int size) {
+	if (size > toSize || (size != 0 && to == NULL)) return -1;
+	if (size != 0) memcpy(to, from, size);
+	return size;
+}
+
+/*
+ * Block in Send or Receive until the transfer was done for us, or the
+ * mailbox was released. The transfer may already be done if someone ran
+ * between queueing us and this call. Whoever wakes us did all the work
+ * already, so waking up to find nothing done is counted as spurious
+ * return the result left by the waker, -3 if the mailbox was released
+ */
+int waitHandOff(int MID, int reason) {
+	shadowPTE *self = shadowEntry(getpid());
+	int spurious = 0;
+	while (! self -> handedOff) {
+		// isBlocked is only set right before blockMe(), with interrupts
+		// off, so wakeWaiter() never unblocks a process that is not blocked
+		self -> isBlocked = 1;
+		self -> waitMbox = MID;
+		blockMe(reason);
+		self -> isBlocked = 0;
+		if (! self -> handedOff) spurious++;
+	}
+	statRecord(statSpurious, spurious);
+	return self -> result;
+}
+
+/*
+ * Finish the Send or Receive of a queued process with the given result,
+ * and unblock it if it got to block
+ */
+void wakeWaiter(int PID, int result) {
+	shadowPTE *waiter = shadowEntry(PID);
+	waiter -> result = result;
+	waiter -> handedOff = 1;
+	if (! waiter -> isBlocked) return;
+	waiter -> isBlocked = 0;
+	unblockProc(PID);
+}
+
 /*
  * Syscall Interrupt Handler, type can be ignored cause it must be syscall
  */
@@ -804,7 +1089,7 @@ void syscallInterruptHandler(int type, void *payload) {
 		USLOSS_Console("%d\n", args -> number);
 		USLOSS_Halt(1);
 	}
-	nullsys(args);
+	systemCallVec[args -> number](args);
 	// restore interrupt
 	restoreInterrupt(currPSR);
 }
@@ -820,10 +1105,26 @@ static void nullsys(systemArgs *args) {
 	USLOSS_Halt(1);
 }
 
+/*
+ * The SYS_POLL handler
+ * System Call Inputs:
+ * 		arg1: array of mailbox ids and POLLDEVICE() ids to watch
+ * 		arg2: number of entries in arg1
+ * 		arg3: array of the same length, set to 1 for every ready entry
+ * System Call Outputs:
+ * 		arg1: number of ready entries
+ * 		arg4: -1 if illegal values were given as input; 0 otherwise
+ */
+void pollsys(systemArgs *args) {
+	int re = PollMbox(args -> arg1, (long) args -> arg2, args -> arg3);
+	args -> arg1 = (void*)(long) (re < 0 ? 0 : re);
+	args -> arg4 = (void*)(long) (re < 0 ? -1 : 0);
+}
+
 /*
  * Check if the Current mode bit on the PSR is 1
  */
-void checkKernelMode() {
+static void checkKernelMode() {
 	if (! (USLOSS_PsrGet() & 1)) {
 		USLOSS_Trace( "ERROR: Attempted to kernel func but not on kernel mode\n");
 		USLOSS_Halt(1);
@@ -833,7 +1134,7 @@ void checkKernelMode() {
 /*
  * Restore to the old PSR
  */
-void restoreInterrupt(int PSR) { 
+static void restoreInterrupt(int PSR) { 
 	int re = USLOSS_PsrSet(PSR);
 	if (re == USLOSS_ERR_INVALID_PSR) {
 		USLOSS_Trace("Error: fail USLOSS_PsrSet()\n");
@@ -845,24 +1146,13 @@ void restoreInterrupt(int PSR) {
  * Read and Edit PSR to disable interrupt
  * Change interrupt bit to 0
  */
-void disableInterrupt() { 
+static void disableInterrupt() { 
 	int re = USLOSS_PsrSet(USLOSS_PsrGet() & 253); 
 	if (re == USLOSS_ERR_INVALID_PSR) {
 		USLOSS_Trace("Error: fail USLOSS_PsrSet()\n");
 		USLOSS_Halt(1);
 	}
 }
-
-/*
- * Turn on interrupt
- */
-void enableInterrupt() { 
-	int re = USLOSS_PsrSet(USLOSS_PsrGet() | 2); 
-	if (re == USLOSS_ERR_INVALID_PSR) {
-		USLOSS_Trace("Error: fail USLOSS_PsrSet()\n");
-		USLOSS_Halt(1);
-	}
-}
 /* ------------------------------------------------------------------------- */
 		
 
@@ -19,12 +19,32 @@
 /* -------------------------------------------------------- Global Variables */
 #define EMPTY	 	0
 #define OCCUPIED 	1
+#define SYS_SPAWNMANY	(MAXSYSCALLS - 4)
 /* ------------------------------------------------------------------------- */
 
 /* -------------------------------------------------------- Helper Functions */
-int launcher(char *arg);
+struct spawnManyArgs;
+struct spawnBatch;
+static int launcher(char *arg);
 void spawn(systemArgs *args);
 int spawnHelper(char *name, int (*func)(char *), char *arg, int stack_size, int priority, int *pid);
+void spawnMany(systemArgs *args);
+int spawnManyHelper(struct spawnManyArgs *req, int *created);
+void spawnManySetup(int pid, void *data);
+int processMailbox(int pid);
+void disableInterrupt();
+void restoreInterrupt(int PSR);
+int semWaitingOn(int pid);
+static struct shadowPTE *shadowEntry(int pid);
+int procShadowRegister(int size);
+void *procShadow(int id, int pid);
+void registerWaitLookups(int (*mbox)(int), int (*sem)(int));
+int statRegister(char *name);
+void statRecord(int id, int value);
+int statStart();
+void statLatency(int id, int start);
+int forkMany(char *name, int(*func)(char *), char *arg, int stacksize, int priority,
+				int count, int *pids, void (*setup)(int, void *), void *data);
 void wait(systemArgs *args);
 int waitHelper(int *pid, int *status);
 void terminate(systemArgs *args);
@@ -44,6 +64,25 @@ int semVHelper(int semaphore);
 /* ------------------------------------------------------------------------- */
 
 /* -------------------------------------------------------------- Structures */
+// What SYS_SPAWNMANY is given, more than fits in the syscall arguments
+typedef struct spawnManyArgs{
+	char *name;
+	int (*func)(char *);
+	char *arg;
+	int stackSize;
+	int priority;
+	int count;
+	int *pids;		// count entries, filled with the PID of each child
+} spawnManyArgs;
+
+// What the children of one SYS_SPAWNMANY share, the last child to copy the
+// argument frees it
+typedef struct spawnBatch{
+	int refs;		// children that have not copied the argument yet
+	int (*func)(char *);
+	char arg[MAXARG];
+} spawnBatch;
+
 typedef struct queue{
 	int ID;
 	struct queue *next;
@@ -51,10 +90,12 @@ typedef struct queue{
 
 typedef struct shadowPTE{
 	int PID;
-	char *arg;
+	spawnBatch *batch;	// until launcher() has copied the argument
 	int(*func)(char *);
 	int status;
-	int mailbox;
+	int mailbox;		// semaphores block the process here
+	int hasMailbox;		// created by the first semP() that has to block
+	int waitSem;		// semaphore blocked on in semP(), -1 if none
 } shadowPTE;
 
 typedef struct semaphore{
@@ -68,15 +109,15 @@ typedef struct semaphore{
 /* ------------------------------------------------------------------------- */
 
 /* --------------------------------------------------------------- Variables */
-// shadow process table
-shadowPTE shadowProcTable[MAXPROC];
+// shadow process table, kept by part 1 so it grows with the process table
+static int shadowTable;
 semaphore semaphores[MAXSEMS];
-// the mailbox for mutex, this mutex is over the whole shadowProcTable[]
-int mutex;
 // help assign semaphore ID
 int currSema;
 // total number of semaphore in the system
 int numSema;
+// latency stats in microseconds, contended means semP blocked or semV woke
+int statPFast, statPSlow, statVFast, statVSlow;
 /* ------------------------------------------------------ Required Functions */
 /*
  * Starting point, other code will call it but it does nothing
@@ -87,16 +128,20 @@ void phase3_start_service_processes() {}
  * Initialize all variables
  */
 void phase3_init(void) {
-	// initialize shadowProcTable and semaphores
-	memset(shadowProcTable, 0, MAXPROC * sizeof(shadowPTE));
-	memset(semaphores, 0, MAXPROC * sizeof(semaphore));
-	// create the mailbox for mutex
-	mutex = MboxCreate(1, 0);
+	// initialize shadow process table and semaphores
+	shadowTable = procShadowRegister(sizeof(shadowPTE));
+	memset(semaphores, 0, MAXSEMS * sizeof(semaphore));
 	// initialize all other value
 	currSema = 0;
 	numSema = 0;
+	statPFast = statRegister("sem_p_uncontended_us");
+	statPSlow = statRegister("sem_p_contended_us");
+	statVFast = statRegister("sem_v_uncontended_us");
+	statVSlow = statRegister("sem_v_contended_us");
+	registerWaitLookups(NULL, semWaitingOn);
 	// Register all the syscall handler
 	systemCallVec[SYS_SPAWN] = spawn;
+	systemCallVec[SYS_SPAWNMANY] = spawnMany;
 	systemCallVec[SYS_WAIT] = wait;
 	systemCallVec[SYS_TERMINATE] = terminate;
 	systemCallVec[SYS_GETTIMEOFDAY] = getTimeofDay;
@@ -137,43 +182,135 @@ void spawn(systemArgs *args) {
  * 				   -1, if not
  */
 int spawnHelper(char *name, int (*func)(char *), char *arg, int stack_size, int priority, int *pid) {
-	// lock
-	MboxSend(mutex, NULL, 0);
-	// fork the new process
-	*pid = fork1(name, launcher, arg, stack_size, priority);
-	if (*pid < 0) {
+	// a batch of one, forkMany() fills the shadow entry with interrupts
+	// off before the child can run, so neither a lock nor a handshake
+	// with launcher() is needed
+	spawnManyArgs one;
+	one.name = name;
+	one.func = func;
+	one.arg = arg;
+	one.stackSize = stack_size;
+	one.priority = priority;
+	one.count = 1;
+	one.pids = pid;
+	int created;
+	if (spawnManyHelper(&one, &created) == -1) {
 		*pid = -1;
 		return -1;
 	}
-	// store info into shadowProcTable
-	// if the child process is not filled yet
-	if (shadowProcTable[*pid % MAXPROC].status == EMPTY) {
-		shadowProcTable[*pid % MAXPROC].PID = *pid;
-		shadowProcTable[*pid % MAXPROC].status = OCCUPIED;
-		shadowProcTable[*pid % MAXPROC].mailbox = MboxCreate(0, 0);
+	return 0;
+}
+
+/*
+ * The SYS_SPAWNMANY handler
+ * System Call Inputs:
+ * 		arg1: pointer to a spawnManyArgs
+ * System Call Outputs: 
+ * 		arg1: number of children created, may be less than asked for if
+ * 			  the process table filled up
+ * 		arg4: -1 if illegal values were given as input; 0 otherwise
+ */
+void spawnMany(systemArgs *args) {
+	int created;
+	int re = spawnManyHelper(args -> arg1, &created);
+	args -> arg1 = (void*)(long) created;
+	args -> arg4 = (void*)(long) re;
+}
+
+/*
+ * The SYS_SPAWNMANY handler helper
+ * Same as spawnHelper() for count children that share func, arg, stack size
+ * and priority. The shadow entries are filled before any child runs and
+ * the argument is copied once for the whole batch
+ * @return: 		0, if at least one child was created
+ * 				   -1, if not
+ */
+int spawnManyHelper(spawnManyArgs *req, int *created) {
+	*created = 0;
+	if (req == NULL || req -> pids == NULL || req -> count <= 0) return -1;
+	// the children share one kernel copy of the argument
+	spawnBatch *batch = malloc(sizeof(spawnBatch));
+	if (batch == NULL) return -1;
+	batch -> refs = 0;
+	batch -> func = req -> func;
+	batch -> arg[0] = '\0';
+	if (req -> arg != NULL) {
+		strncpy(batch -> arg, req -> arg, MAXARG - 1);
+		batch -> arg[MAXARG - 1] = '\0';
+	}
+	int re = forkMany(req -> name, launcher, batch -> arg, req -> stackSize, 
+						req -> priority, req -> count, req -> pids, spawnManySetup, batch);
+	if (re <= 0) {
+		free(batch);
+		return -1;
 	}
-	shadowProcTable[*pid % MAXPROC].arg = malloc(MAXARG);
-	if (arg == NULL) shadowProcTable[*pid % MAXPROC].arg = "";
-	else strcpy(shadowProcTable[*pid % MAXPROC].arg, arg);
-	shadowProcTable[*pid % MAXPROC].func = func;
-	MboxCondSend(shadowProcTable[*pid % MAXPROC].mailbox, NULL, 0);
-	// unlock
-	MboxReceive(mutex, NULL, 0);
+	*created = re;
 	return 0;
 }
 
+/*
+ * Called by forkMany() for each child before it can run
+ * The slot may have belonged to a kernel process that blocked in semP()
+ * and quit without Terminate(), so its mailbox is released here
+ */
+void spawnManySetup(int pid, void *data) {
+	spawnBatch *batch = data;
+	shadowPTE *child = shadowEntry(pid);
+	if (child -> hasMailbox) MboxRelease(child -> mailbox);
+	child -> PID = pid;
+	child -> status = OCCUPIED;
+	child -> waitSem = -1;
+	child -> hasMailbox = 0;
+	child -> mailbox = 0;
+	child -> batch = batch;
+	child -> func = batch -> func;
+	batch -> refs++;
+}
+
+/*
+ * Return the mailbox a process blocks on in semP(), create it the first time
+ * Spawned processes do not need one to start, most never block on a semaphore
+ */
+int processMailbox(int pid) {
+	if (! shadowEntry(pid) -> hasMailbox) {
+		shadowEntry(pid) -> mailbox = MboxCreate(0, 0);
+		shadowEntry(pid) -> hasMailbox = 1;
+	}
+	return shadowEntry(pid) -> mailbox;
+}
+
+/*
+ * Return the semaphore a process is blocked on in semP(), -1 if none
+ * Used by the sentinel to report what a deadlocked process waits for
+ */
+int semWaitingOn(int pid) {
+	if (shadowEntry(pid) -> status != OCCUPIED
+			|| shadowEntry(pid) -> PID != pid) return -1;
+	return shadowEntry(pid) -> waitSem;
+}
+
+/*
+ * Return the shadow process table entry of a process
+ */
+static shadowPTE *shadowEntry(int pid) {
+	return procShadow(shadowTable, pid);
+}
+
 /*
  * Trampoline for user mode process
  */
-int launcher(char *arg) {
+static int launcher(char *arg) {
+	// the shadow entry was filled by spawnManySetup() before we could run
 	int pid = getpid();
-	// if shadow proc table is not set up yet
-	if (shadowProcTable[pid % MAXPROC].status == EMPTY) {
-		shadowProcTable[pid % MAXPROC].status = OCCUPIED;
-		shadowProcTable[pid % MAXPROC].PID = pid;
-		shadowProcTable[pid % MAXPROC].mailbox = MboxCreate(0, 0);
-		MboxReceive(shadowProcTable[pid % MAXPROC].mailbox, NULL, 0);
-	}
+	shadowPTE *self = shadowEntry(pid);
+	// copy the batch's argument, the last child of the batch frees it
+	char copy[MAXARG];
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	strcpy(copy, self -> batch -> arg);
+	if (--self -> batch -> refs == 0) free(self -> batch);
+	self -> batch = NULL;
+	restoreInterrupt(currPSR);
 	// disable kernel mode. This is the only exception we can call USLOSS_PsrSet()
 	int re = USLOSS_PsrSet(USLOSS_PsrGet() & 254); // 1111 1110
 	if (re == USLOSS_ERR_INVALID_PSR) {
@@ -181,7 +318,7 @@ int launcher(char *arg) {
 		USLOSS_Halt(1);
 	}
 	// call the user main function in user mode
-	int result = shadowProcTable[pid % MAXPROC].func(shadowProcTable[pid % MAXPROC].arg);
+	int result = self -> func(copy);
 	// call Terminate() if it returns
 	Terminate(result);
 	return 0;
@@ -233,7 +370,9 @@ void terminateHelper(int status) {
 		int re = join(&childPID);
 		if (re == -2) break;
 	}
-	memset(&shadowProcTable[getpid() % MAXPROC], 0, 1 * sizeof(shadowPTE));
+	if (shadowEntry(getpid()) -> hasMailbox)
+		MboxRelease(shadowEntry(getpid()) -> mailbox);
+	memset(shadowEntry(getpid()), 0, 1 * sizeof(shadowPTE));
 	quit(status);
 }
 
@@ -344,15 +483,19 @@ void semP(systemArgs *args) {
  */
 int semPHelper(int semaphore) {
 	if (semaphores[semaphore].status != OCCUPIED) return -1;
+	int start = statStart();
+	int stat = statPFast;
 	// lock the value critical section
 	MboxSend(semaphores[semaphore].mutex, NULL, 0);
 	// decrement the value by 1
 	semaphores[semaphore].value--;
 	// block self on semaphore if value < 0
 	if (semaphores[semaphore].value < 0) {
+		stat = statPSlow;
 		// unlock the value critical section
 		MboxReceive(semaphores[semaphore].mutex, NULL, 0);
-		// block itself
+		// block itself, make sure semV() has a mailbox to wake us with
+		processMailbox(getpid());
 		queue *curr = malloc(sizeof(queue));
 		curr -> ID = getpid();
 		curr -> next = NULL;
@@ -363,10 +506,13 @@ int semPHelper(int semaphore) {
 			semaphores[semaphore].blockedTail -> next = curr;
 			semaphores[semaphore].blockedTail = curr;
 		}
-		MboxReceive(shadowProcTable[getpid() % MAXPROC].mailbox, NULL, 0);
+		shadowEntry(getpid()) -> waitSem = semaphore;
+		MboxReceive(processMailbox(getpid()), NULL, 0);
+		shadowEntry(getpid()) -> waitSem = -1;
 	} 
 	// unlock the value critical section
 	MboxReceive(semaphores[semaphore].mutex, NULL, 0);
+	statLatency(stat, start);
 	return 0;
 }
 
@@ -388,6 +534,7 @@ void semV(systemArgs *args) {
  */
 int semVHelper(int semaphore) {
 	if (semaphores[semaphore].status != OCCUPIED) return -1;
+	int start = statStart();
 	// lock the value critical section
 	MboxSend(semaphores[semaphore].mutex, NULL, 0);
 	// increment the value by 1
@@ -399,11 +546,15 @@ int semVHelper(int semaphore) {
 		semaphores[semaphore].blockedHead = curr -> next;
 		if (semaphores[semaphore].blockedHead == NULL)
 			semaphores[semaphore].blockedTail = NULL;
-		else if (semaphores[semaphore].blockedHead -> next != NULL)
-			semaphores[semaphore].blockedTail = semaphores[semaphore].blockedTail -> next;
-		MboxSend(shadowProcTable[curr -> ID % MAXPROC].mailbox, NULL, 0);
+		int mailbox = shadowEntry(curr -> ID) -> mailbox;
+		free(curr);
+		MboxSend(mailbox, NULL, 0);
+		statLatency(statVSlow, start);
 	// else unlock the value critical section
-	} else MboxReceive(semaphores[semaphore].mutex, NULL, 0);
+	} else {
+		MboxReceive(semaphores[semaphore].mutex, NULL, 0);
+		statLatency(statVFast, start);
+	}
 	return 0;
 }
 	
@@ -24,17 +24,42 @@
 #define READ		0
 #define WRITE		1
 #define MAXDISK		32	// this is bad
+// read-ahead and write-behind, tune DISK_PREFETCH_DEPTH to read further ahead
+#define DISK_PREFETCH_DEPTH		2	// tracks read ahead of a sequential reader
+#define DISK_CACHE_LINES		(DISK_PREFETCH_DEPTH + 2)	// cached tracks per unit
+#define DISK_WRITEBEHIND_DELAY	1000000	// flush an idle dirty track after 1s
+#define TRACKBYTES	(USLOSS_DISK_TRACK_SIZE * USLOSS_DISK_SECTOR_SIZE)
+#define TERM_OUT_SIZE	(4 * MAXLINE)	// output bytes buffered per terminal
+#define TERM_IN_LINES	10	// completed input lines buffered per terminal
+// extra syscalls, numbered down from the top of systemCallVec[] so they stay
+// clear of usyscall.h
+#define SYS_TERMREADCOND	(MAXSYSCALLS - 1)
+#define SYS_TERMREADTIMED	(MAXSYSCALLS - 2)
 /* ------------------------------------------------------------------------- */
 
 /* ------------------------------------------------------- Helper Functions */
+struct wakeUpQueue;
+struct diskRequestQueue;
+struct trackCache;
 int clockDriver(char *arg);
 void sleep(systemArgs *args);
 int sleepHelper(int seconds);
+void wakeUpInsert(struct wakeUpQueue *temp);
+void wakeUpRemove(struct wakeUpQueue *temp);
 int terminalDriver(char *arg);
 void termRead(systemArgs *args);
 int termReadHelper(char *buffer, int bufSize, int unit, int *lenOut);
+void termReadCond(systemArgs *args);
+void termReadTimed(systemArgs *args);
+int termReadLine(char *buffer, int bufSize, int unit, int *lenOut, int timeout);
+int termTakeLine(int unit, char *buffer, int bufSize);
 void termWrite(systemArgs * args);
 int termWriteHelper(char *buffer, int bufSize, int unit, int *lenOut);
+void termControl(int unit, int control);
+void termXmit(int unit);
+void termRecv(int unit, char c);
+void termHandleStatus(int unit, int status);
+int condDeviceWait(int type, int unit, int *status);
 int diskDriver(char *arg);
 void diskSize(systemArgs * args);
 int diskSizeHelper(int unit, int *sector, int *track, int *disk);
@@ -42,40 +67,122 @@ void diskRead(systemArgs * args);
 void diskWrite(systemArgs * args);
 int diskRequestHelper(void *buffer, int unit, int track, int firstBlock, 
 						int blocks, int *statusOut, int type);
+void diskTrackRequest(void *buffer, int unit, int track, int firstBlock, 
+						int blocks, int *statusOut, int type);
+int diskDeviceOp(int unit, int opr, void *reg1, void *reg2);
+int diskSeek(int unit, int track);
+int diskHasRequests(int unit);
+int diskStreamUpdate(int unit, int track, int firstBlock, int blocks, int type);
+int procShadowRegister(int size);
+void *procShadow(int id, int pid);
+struct trackCache *diskCacheLookup(int unit, int track);
+struct trackCache *diskCacheVictim(int unit);
+int diskCacheRead(void *buffer, int unit, int track, int firstBlock, int blocks);
+int diskCacheWrite(void *buffer, int unit, int track, int firstBlock, int blocks,
+						int behind);
+void diskCacheOverlay(void *buffer, int unit, int track, int firstBlock, int blocks);
+int diskFillLine(int unit, struct trackCache *line, int track);
+void diskFlushLine(int unit, struct trackCache *line);
+int diskCacheFlushable(struct trackCache *line);
+void diskIdle(int unit);
+void diskServeTrack(int unit, int track);
+void diskServeRun(int unit, int track, struct diskRequestQueue *run);
+void diskRecordRequest(int unit, int type, int re, int blocks, int start);
+void registerClockTickHook(void (*hook)(void));
+void noClockTick(void);
+void disableInterrupt();
+void restoreInterrupt(int PSR);
+int deviceReady(int type, int unit);
+void registerDevicePoll(int (*ready)(int type, int unit));
+void deviceDataReady(int type, int unit);
+int statRegister(char *name);
+void statRecord(int id, int value);
+int statStart();
+void statLatency(int id, int start);
 /* ------------------------------------------------------------------------- */
 
 /* -------------------------------------------------------------- Structures */
 typedef struct wakeUpQueue {
 	int wakeUpTime;
 	int PID;
+	int mbox;	// -1 to unblock PID, otherwise a timeout to send to this mailbox
+	int fired;
 	struct wakeUpQueue *next;
 } wakeUpQueue;
 
+// output waiting to be sent on one terminal
+typedef struct termRing {
+	char data[TERM_OUT_SIZE];
+	int head;		// next byte to transmit
+	int count;		// bytes waiting
+	int xmitOn;		// transmit interrupts are enabled
+	int waiting;	// writers blocked because the ring is full
+} termRing;
+
+// input typed on one terminal, completed lines wait here for a reader
+typedef struct termInput {
+	char lines[TERM_IN_LINES][MAXLINE];
+	int lineLen[TERM_IN_LINES];
+	int head;		// oldest completed line
+	int count;		// completed lines waiting
+	int curLen;		// length of the line being typed, stored after the last
+	int waiting;	// readers blocked for a line
+	int dropped;	// characters thrown away because every line was full
+} termInput;
+
 typedef struct diskRequestQueue {
 	int PID;
 	int type; // READ or WRITE
 	int firstBlock;
 	int numBlocks;
-	void *buffer;
+	void *buffer;	// points at data, the driver never sees the caller's memory
 	int status;
+	int done;		// served, set by the driver
+	int blocked;	// the caller is in blockMe() waiting for done
 	struct diskRequestQueue *last;
 	struct diskRequestQueue *next;
+	char data[TRACKBYTES];	// the caller copies to or from here itself
 } diskRequestQueue;
+
+// filled in once by the disk driver at boot, read only afterwards
+typedef struct diskGeometry {
+	int sectorSize;	// size of disk sector in bytes
+	int trackSize;	// number of sectors in a track
+	int numTracks;	// number of disk tracks, -1 until probed
+} diskGeometry;
+
+// one cached track, used both for read-ahead and for write-behind
+typedef struct trackCache {
+	int track;							// -1 if the line holds nothing
+	int valid[USLOSS_DISK_TRACK_SIZE];	// sector holds the latest data
+	int dirty[USLOSS_DISK_TRACK_SIZE];	// sector not written to disk yet
+	int numDirty;
+	int flushReady;						// the writer has moved past this track
+	int dirtySince;						// time of the first unflushed write
+	int lastUsed;						// for LRU replacement
+	char data[TRACKBYTES];
+} trackCache;
+
+// where each process's next request would start if it is sequential
+typedef struct diskStream {
+	int PID;
+	int unit;
+	int type;
+	int nextTrack;
+	int nextBlock;
+	int lastTrack;
+	int runLength;	// number of back to back contiguous requests
+} diskStream;
 /* ------------------------------------------------------------------------- */
 
 /* --------------------------------------------------------------- Variables */
 // terminal related, initialized in init
 int termWriteLock[USLOSS_TERM_UNITS];
-int termWriteFinish[USLOSS_TERM_UNITS];
+int termWriteSpace[USLOSS_TERM_UNITS];
 int termReadLock[USLOSS_TERM_UNITS];
-int termReadFinish[USLOSS_TERM_UNITS];
-char toWrite[MAXLINE];
-char toRead[MAXLINE];
-int readIndex;
-
-// int canWrite;
-// wakeUpQueue *writeHead[USLOSS_TERM_UNITS];
-// wakeUpQueue *writeTail[USLOSS_TERM_UNITS];
+int termReadReady[USLOSS_TERM_UNITS];
+termRing termOut[USLOSS_TERM_UNITS];
+termInput termIn[USLOSS_TERM_UNITS];
 
 // used in start processes
 int clockDriverPID;
@@ -85,12 +192,34 @@ int terminalDriverPID[USLOSS_TERM_UNITS];
 int firstTrack[USLOSS_DISK_UNITS][2];
 wakeUpQueue *wakeUpHead;
 int diskRequestLock;
-int numDiskTracks[USLOSS_DISK_UNITS];
-int diskSizeMailbox[USLOSS_DISK_UNITS][2];
+diskGeometry diskGeo[USLOSS_DISK_UNITS];
+// each driver sends here once, after it published its disk's geometry
+int diskProbed[USLOSS_DISK_UNITS];
 diskRequestQueue *diskRequests[USLOSS_DISK_UNITS][MAXDISK][2];
 int diskMailbox[USLOSS_DISK_UNITS]; 
 // global disk request
 USLOSS_DeviceRequest globalDiskRequest;
+// read-ahead and write-behind
+int diskHead[USLOSS_DISK_UNITS];
+int diskCacheLock[USLOSS_DISK_UNITS];
+int diskCacheClock;
+trackCache diskCache[USLOSS_DISK_UNITS][DISK_CACHE_LINES];
+int diskStreams;	// shadow table in part 1, one diskStream per process
+int prefetchNext[USLOSS_DISK_UNITS];
+int prefetchEnd[USLOSS_DISK_UNITS];
+// per unit stats: request latency in microseconds by type, request size in
+// blocks, requests served from the cache, and tracks crossed per seek
+int statDiskRead[USLOSS_DISK_UNITS];
+int statDiskWrite[USLOSS_DISK_UNITS];
+int statDiskBlocks[USLOSS_DISK_UNITS];
+int statDiskCached[USLOSS_DISK_UNITS];
+int statDiskSeek[USLOSS_DISK_UNITS];
+// typed characters thrown away per terminal, one sample each
+int statTermDropped[USLOSS_TERM_UNITS];
+// merged requests are transferred through here
+char diskRunBuffer[USLOSS_DISK_UNITS][TRACKBYTES];
+// run by the clock driver on every tick, part 5 installs its page sampling
+void (*clockTickHook)(void) = noClockTick;
 /* ------------------------------------------------------ Required Functions */
 /*
  * Fork all the required device drivers
@@ -113,6 +242,10 @@ void phase4_start_service_processes() {
 									USLOSS_MIN_STACK, 2);
 	terminalDriverPID[3] = fork1("terminalDriver4", terminalDriver, "3", 
 									USLOSS_MIN_STACK, 2);
+	// the disk drivers probe the geometry as soon as they start, block until
+	// both have so SYS_DISKSIZE never has to wait
+	for (int i = 0; i < USLOSS_DISK_UNITS; i++)
+		MboxReceive(diskProbed[i], NULL, 0);
 }
 
 /*
@@ -122,6 +255,8 @@ void phase4_init(void) {
 	// register all the syscall handler
 	systemCallVec[SYS_SLEEP] = sleep;
 	systemCallVec[SYS_TERMREAD] = termRead;
+	systemCallVec[SYS_TERMREADCOND] = termReadCond;
+	systemCallVec[SYS_TERMREADTIMED] = termReadTimed;
 	systemCallVec[SYS_TERMWRITE] = termWrite;
 	systemCallVec[SYS_DISKSIZE] = diskSize;
 	systemCallVec[SYS_DISKREAD] = diskRead;
@@ -129,25 +264,48 @@ void phase4_init(void) {
 	// terminal related
 	for (int i = 0; i < USLOSS_TERM_UNITS; i++) {
 		termWriteLock[i] = MboxCreate(1, 0);
-		termWriteFinish[i] = MboxCreate(0, 0);
+		termWriteSpace[i] = MboxCreate(1, 0);
 		termReadLock[i] = MboxCreate(1, 0);
-		termReadFinish[i] = MboxCreate(0, 0);
+		termReadReady[i] = MboxCreate(1, 0);
+		memset(&termOut[i], 0, sizeof(termRing));
+		memset(&termIn[i], 0, sizeof(termInput));
+		char name[MAXNAME];
+		snprintf(name, MAXNAME, "term%d_dropped_chars", i);
+		statTermDropped[i] = statRegister(name);
 	}
-	readIndex = 0;
-
-	// canWrite = 1;
 
 	// clock and disk related
 	wakeUpHead = NULL;
 	diskRequestLock = MboxCreate(1, 0);
 	for(int i = 0; i < USLOSS_DISK_UNITS; i++) {
-		numDiskTracks[i] = -1;
-		diskSizeMailbox[i][0] = MboxCreate(0, 0);
-		diskSizeMailbox[i][1] = 0;
+		diskGeo[i].numTracks = -1;
+		diskProbed[i] = MboxCreate(1, 0);
 		diskMailbox[i] = MboxCreate(1, 0);
 		firstTrack[i][0] = -1;
 		firstTrack[i][1] = 0;
+		diskHead[i] = 0;
+		diskCacheLock[i] = MboxCreate(1, 0);
+		for (int j = 0; j < DISK_CACHE_LINES; j++) {
+			memset(&diskCache[i][j], 0, sizeof(trackCache));
+			diskCache[i][j].track = -1;
+		}
+		prefetchNext[i] = 0;
+		prefetchEnd[i] = 0;
+		char name[MAXNAME];
+		snprintf(name, MAXNAME, "disk%d_read_us", i);
+		statDiskRead[i] = statRegister(name);
+		snprintf(name, MAXNAME, "disk%d_write_us", i);
+		statDiskWrite[i] = statRegister(name);
+		snprintf(name, MAXNAME, "disk%d_blocks", i);
+		statDiskBlocks[i] = statRegister(name);
+		snprintf(name, MAXNAME, "disk%d_cached_blocks", i);
+		statDiskCached[i] = statRegister(name);
+		snprintf(name, MAXNAME, "disk%d_seek_tracks", i);
+		statDiskSeek[i] = statRegister(name);
 	}
+	diskCacheClock = 0;
+	diskStreams = procShadowRegister(sizeof(diskStream));
+	registerDevicePoll(deviceReady);
 }
 /* ------------------------------------------------------------------------- */
 
@@ -156,10 +314,9 @@ void phase4_init(void) {
  */
 void test() {
 	int currPSR = USLOSS_PsrGet();
-	int reval = USLOSS_PsrSet(currPSR | 1); // 0000 0001
+	USLOSS_PsrSet(currPSR | 1); // 0000 0001
 	dumpProcesses();
-	if (reval) ;
-	reval = USLOSS_PsrSet(currPSR);
+	USLOSS_PsrSet(currPSR);
 }
 
 
@@ -167,6 +324,18 @@ void test() {
 /* 				  						     Some of these are also required */
 /* 	     but not specified in phase3.h and won't be called by any test cases */
 
+/*
+ * Installed as part 2's device poll hook, a terminal is ready once a whole
+ * line is buffered and a disk once no request is queued on it
+ * @return:		1, if a read on the terminal would not block, or a disk
+ * 				   request would not queue behind others
+ * 				0, otherwise
+ */
+int deviceReady(int type, int unit) {
+	if (type == USLOSS_TERM_INT) return termIn[unit].count > 0;
+	return ! diskHasRequests(unit);
+}
+
 /*
  * Clock driver, wake up processes
  * Infinitely loop here
@@ -182,14 +351,42 @@ int clockDriver(char *arg) {
 				wakeUpQueue *curr = wakeUpHead;
 				if (wakeUpHead -> next == NULL) wakeUpHead = NULL;
 				else wakeUpHead = wakeUpHead -> next;
-				unblockProc(curr -> PID);
-				free(curr);
+				// timeouts belong to the waiter, it frees them
+				if (curr -> mbox != -1) {
+					curr -> fired = 1;
+					MboxCondSend(curr -> mbox, NULL, 0);
+				} else {
+					unblockProc(curr -> PID);
+					free(curr);
+				}
 			} else break;
 		}
+		// nudge the disk drivers so write-behind data does not linger
+		for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
+			for (int j = 0; j < DISK_CACHE_LINES; j++) {
+				if (diskCache[i][j].numDirty > 0) {
+					MboxCondSend(diskMailbox[i], NULL, 0);
+					break;
+				}
+			}
+		}
+		// let a higher phase do its periodic work, e.g. paging stats
+		clockTickHook();
 	}
 	return status;
 }
 
+/*
+ * Called by a higher phase from its init, hook runs in the clock driver on
+ * every tick and must not block
+ */
+void registerClockTickHook(void (*hook)(void)) { clockTickHook = hook; }
+
+/*
+ * The clock tick hook used until a phase installs its own
+ */
+void noClockTick(void) {}
+
 /*
  * The SYS_SLEEP handler
  * Pauses the current process for the specified amount of time
@@ -210,30 +407,47 @@ void sleep(systemArgs *args) {
 int sleepHelper(int seconds) {
 	if (seconds < 0) return -1;
 	// add this process to wake up queue
-	int wakeUpTime = currentTime() + (seconds * 1000000);
 	wakeUpQueue *temp = malloc(sizeof(wakeUpQueue));
-	temp -> wakeUpTime = wakeUpTime;
+	temp -> wakeUpTime = currentTime() + (seconds * 1000000);
 	temp -> PID = getpid();
+	temp -> mbox = -1;
+	temp -> fired = 0;
+	wakeUpInsert(temp);
+	blockMe(30); // arbitrary number 30	
+	return 0;
+}
+
+/*
+ * Add an entry to the wake up queue, keeping it sorted by wake up time
+ */
+void wakeUpInsert(wakeUpQueue *temp) {
 	temp -> next = NULL;
-	// keep the wake up queue sorted
-	if (wakeUpHead == NULL) wakeUpHead = temp;
-	else {
-		wakeUpQueue *curr = wakeUpHead;
-		for (; curr != NULL; curr = curr -> next) {
-
-			if (curr -> next == NULL) {
-				curr -> next = temp;
-				break;
-			} else if (curr -> wakeUpTime <= wakeUpTime
-						&& curr -> next -> wakeUpTime >= wakeUpTime) {
-				temp -> next = curr -> next;
-				curr -> next = temp;
-				break;
-			}
+	if (wakeUpHead == NULL || temp -> wakeUpTime < wakeUpHead -> wakeUpTime) {
+		temp -> next = wakeUpHead;
+		wakeUpHead = temp;
+		return;
+	}
+	wakeUpQueue *curr = wakeUpHead;
+	for (; curr -> next != NULL && curr -> next -> wakeUpTime <= temp -> wakeUpTime; )
+		curr = curr -> next;
+	temp -> next = curr -> next;
+	curr -> next = temp;
+}
+
+/*
+ * Take an entry off the wake up queue if the clock driver has not already
+ */
+void wakeUpRemove(wakeUpQueue *temp) {
+	if (wakeUpHead == temp) {
+		wakeUpHead = temp -> next;
+		return;
+	}
+	for (wakeUpQueue *curr = wakeUpHead; curr != NULL; curr = curr -> next) {
+		if (curr -> next == temp) {
+			curr -> next = temp -> next;
+			return;
 		}
 	}
-	blockMe(30); // arbitrary number 30	
-	return 0;
 }
 
 /*
@@ -241,53 +455,44 @@ int sleepHelper(int seconds) {
  */
 int terminalDriver(char *arg) {
 	int unit = atoi(arg);
-	int status, re, control;
-	// enable read and write interrupt
-	control = 6;
-	re = USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, &control);
-	if (re == USLOSS_DEV_INVALID) 
-		USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in terminal driver\n");
+	int status, re;
+	// enable read interrupt, transmit interrupts are only on while there
+	// is output in the ring
+	termControl(unit, USLOSS_TERM_CTRL_RECV_INT(0));
 	while (1) {
 		re = waitDevice(USLOSS_TERM_INT, unit, &status);
 		if (re == USLOSS_DEV_INVALID) 
 			USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in terminal driver\n");
-		// if write available
-		if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY) {
-			for (int i = 0; i < strlen(toWrite); i++) {
-				control = 0;
-				control = USLOSS_TERM_CTRL_CHAR(control, toWrite[i]);
-				control = USLOSS_TERM_CTRL_XMIT_INT(control);
-				control = USLOSS_TERM_CTRL_RECV_INT(control);
-				control = USLOSS_TERM_CTRL_XMIT_CHAR(control);
-				re = USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit,((void *)(long) control));
-				if (re == USLOSS_DEV_INVALID) 
-					USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in terminal driver\n");
-				// wait till the current write finished
-				while (1) {
-					re = waitDevice(USLOSS_TERM_INT, unit, &status);
-					if (re == USLOSS_DEV_INVALID) 
-						USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in terminal driver\n");
-					if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY) break;
-					else if (USLOSS_TERM_STAT_XMIT(status == USLOSS_DEV_ERROR))
-						USLOSS_Trace("Error in terminal write\n");
-				}
-			}
-			MboxSend(termWriteFinish[unit], NULL, 0);
-		}
-		// if read available
-		if (USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_READY) {
-			char c = USLOSS_TERM_STAT_CHAR(status);
-			toRead[readIndex] = c;
-			readIndex++;
-			if (readIndex == MAXLINE || c == '\n') {
-				readIndex = 0;
-				MboxSend(termReadFinish[unit], NULL, 0);
-			}
-		}
+		termHandleStatus(unit, status);
+		// handle everything that queued up while we were busy before
+		// going back to sleep, one wake up for a burst of interrupts
+		while (condDeviceWait(USLOSS_TERM_INT, unit, &status) == 0)
+			termHandleStatus(unit, status);
 	}
 	return 0;
 }
 
+/*
+ * Act on one terminal status taken from the interrupt queue
+ */
+void termHandleStatus(int unit, int status) {
+	// if write available, send the next buffered character; a queued ready
+	// may be stale once we already sent after it, so ask the device again
+	if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY) {
+		int live = 0;
+		USLOSS_DeviceInput(USLOSS_TERM_DEV, unit, &live);
+		if (USLOSS_TERM_STAT_XMIT(live) == USLOSS_DEV_READY) 
+			termXmit(unit);
+	}
+	else if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_ERROR)
+		USLOSS_Trace("Error in terminal write\n");
+	// if a character was received
+	if (USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_BUSY) 
+		termRecv(unit, USLOSS_TERM_STAT_CHAR(status));
+	else if (USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_ERROR)
+		USLOSS_Trace("Error in terminal read\n");
+}
+
 /*
  * The SYS_TERMREAD handler
  * System Call Outputs: 
@@ -304,20 +509,156 @@ void termRead(systemArgs *args) {
 }
 
 /*
- * The actual SYS_TERMREAD handler   
+ * The SYS_TERMREADCOND handler, same arguments as SYS_TERMREAD but never blocks
+ * System Call Outputs: 
+ * 			arg2: 		number of characters read
+ * 			arg4:	   -2, if nothing was typed yet
+ * 					   -1, if illegal values were given as input
+ * 						0, otherwise
+ */
+void termReadCond(systemArgs *args) {
+	int lenOut;
+	int re = termReadLine((char*)args -> arg1, (long) args -> arg2, 
+									(long) args -> arg3, &lenOut, 0);
+	args->arg2 = (void*)((long)lenOut);
+	args->arg4 = (void*)(long) re;
+}
+
+/*
+ * The SYS_TERMREADTIMED handler, arg5 is the timeout in milliseconds
+ * System Call Outputs: 
+ * 			arg2: 		number of characters read
+ * 			arg4:	   -2, if nothing was typed before the timeout
+ * 					   -1, if illegal values were given as input
+ * 						0, otherwise
+ */
+void termReadTimed(systemArgs *args) {
+	int lenOut;
+	int timeout = (long) args -> arg5;
+	int re = -1;
+	if (timeout >= 0)
+		re = termReadLine((char*)args -> arg1, (long) args -> arg2, 
+								(long) args -> arg3, &lenOut, timeout);
+	else lenOut = 0;
+	args->arg2 = (void*)((long)lenOut);
+	args->arg4 = (void*)(long) re;
+}
+
+/*
+ * The actual SYS_TERMREAD handler
+ * Return the oldest buffered line, blocking only if none was typed yet
  */
 int termReadHelper(char *buffer, int bufSize, int unit, int *lenOut) {
+	return termReadLine(buffer, bufSize, unit, lenOut, -1);
+}
+
+/*
+ * Read one line from a terminal
+ * timeout is -1 to wait for a full line, 0 to not block at all, or the number
+ * of milliseconds to wait. When it runs out, whatever part of a line has been
+ * typed so far is returned instead, so a partial line has no '\n' at the end
+ * @return: 	   -2, if nothing was typed in time
+ * 				   -1, if illegal values were given as input
+ * 					0, otherwise
+ */
+int termReadLine(char *buffer, int bufSize, int unit, int *lenOut, int timeout) {
+	*lenOut = 0;
 	if (unit < 0 || unit >= USLOSS_TERM_UNITS) return -1;
 	if (bufSize < 0 || bufSize > MAXLINE) return -1;
-	// lock read
-	MboxSend(termReadLock[unit], NULL, 0);
-	// waiting for driver to finish
-	MboxReceive(termReadFinish[unit], NULL, 0);
-	*lenOut = strlen(toRead);
-	memset(toRead, '\0', MAXLINE);
+	termInput *in = &termIn[unit];
+	// lock read, a non-blocking read must not wait for another reader either
+	if (timeout == 0) {
+		if (MboxCondSend(termReadLock[unit], NULL, 0) != 0) return -2;
+	} else MboxSend(termReadLock[unit], NULL, 0);
+	// the driver adds to the lines and the clock driver to the wake up queue,
+	// keep interrupts off so neither runs halfway through our update
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	// the clock driver sends to termReadReady when the time is up
+	wakeUpQueue *alarm = NULL;
+	if (timeout > 0 && in -> count == 0) {
+		alarm = malloc(sizeof(wakeUpQueue));
+		alarm -> wakeUpTime = currentTime() + (timeout * 1000);
+		alarm -> PID = getpid();
+		alarm -> mbox = termReadReady[unit];
+		alarm -> fired = 0;
+		wakeUpInsert(alarm);
+	}
+	// wait for the driver to complete a line if none is buffered
+	while (in -> count == 0 && timeout != 0 && (alarm == NULL || ! alarm -> fired)) {
+		in -> waiting = 1;
+		MboxReceive(termReadReady[unit], NULL, 0);
+	}
+	if (alarm != NULL) {
+		if (! alarm -> fired) wakeUpRemove(alarm);
+		free(alarm);
+	}
+	int re = 0;
+	*lenOut = termTakeLine(unit, buffer, bufSize);
+	if (*lenOut == 0 && in -> count == 0) re = -2;
+	restoreInterrupt(currPSR);
 	// unlock read
 	MboxReceive(termReadLock[unit], NULL, 0);
-	return 0;
+	return re;
+}
+
+/*
+ * Copy the oldest completed line into buffer, or if there is none, whatever
+ * has been typed of the current line. Anything of a completed line past
+ * bufSize is discarded, a partial line keeps the rest for the next read
+ * Called with interrupts off, termRecv() changes the same fields
+ * @return:		the number of characters copied
+ */
+int termTakeLine(int unit, char *buffer, int bufSize) {
+	termInput *in = &termIn[unit];
+	int len;
+	if (in -> count > 0) {
+		len = in -> lineLen[in -> head];
+		if (len > bufSize) len = bufSize;
+		memcpy(buffer, in -> lines[in -> head], len);
+		in -> head = (in -> head + 1) % TERM_IN_LINES;
+		in -> count--;
+	} else {
+		char *line = in -> lines[in -> head];
+		len = in -> curLen;
+		if (len > bufSize) len = bufSize;
+		memcpy(buffer, line, len);
+		memmove(line, line + len, in -> curLen - len);
+		in -> curLen -= len;
+	}
+	return len;
+}
+
+/*
+ * Called by the terminal driver for every received character
+ * Never blocks, a character is dropped and counted if every line is taken
+ */
+void termRecv(int unit, char c) {
+	termInput *in = &termIn[unit];
+	// a reader may be taking a partial line out of the same buffer
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	if (in -> count == TERM_IN_LINES) {
+		in -> dropped++;
+		statRecord(statTermDropped[unit], 1);
+		restoreInterrupt(currPSR);
+		return;
+	}
+	int tail = (in -> head + in -> count) % TERM_IN_LINES;
+	in -> lines[tail][in -> curLen] = c;
+	in -> curLen++;
+	if (in -> curLen == MAXLINE || c == '\n') {
+		in -> lineLen[tail] = in -> curLen;
+		in -> curLen = 0;
+		in -> count++;
+		// wake up a blocked reader, and anyone polling the terminal
+		if (in -> waiting) {
+			in -> waiting = 0;
+			MboxCondSend(termReadReady[unit], NULL, 0);
+		}
+		deviceDataReady(USLOSS_TERM_INT, unit);
+	}
+	restoreInterrupt(currPSR);
 }
 
 /*
@@ -341,66 +682,78 @@ void termWrite(systemArgs * args) {
 int termWriteHelper(char *buffer, int bufSize, int unit, int *lenOut) {
 	if (unit < 0 || unit >= USLOSS_TERM_UNITS) return -1;
 	if (bufSize < 0 || bufSize > MAXLINE) return -1;
-	int re, status;
-	// grab the write lock
+	termRing *ring = &termOut[unit];
+	// grab the write lock so the line is not interleaved with other writers
 	MboxSend(termWriteLock[unit], NULL, 0);
+	// the driver takes from the ring as we fill it, keep interrupts off so
+	// it never sees count and head halfway updated
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	for (int i = 0; i < bufSize; ) {
+		// copy as much as fits into the ring
+		for (; i < bufSize && ring -> count < TERM_OUT_SIZE; i++) {
+			ring -> data[(ring -> head + ring -> count) % TERM_OUT_SIZE] = buffer[i];
+			ring -> count++;
+		}
+		// start the transmitter if it is idle
+		if (! ring -> xmitOn && ring -> count > 0) {
+			ring -> xmitOn = 1;
+			termControl(unit, USLOSS_TERM_CTRL_XMIT_INT(USLOSS_TERM_CTRL_RECV_INT(0)));
+		}
+		// ring is full, wait for the driver to drain some of it
+		if (i < bufSize) {
+			ring -> waiting = 1;
+			MboxReceive(termWriteSpace[unit], NULL, 0);
+		}
+	}
+	restoreInterrupt(currPSR);
+	*lenOut = bufSize;
+	// release write lock
+	MboxReceive(termWriteLock[unit], NULL, 0);
+	return 0;
+}
 
-	// somehow the mutex is not working so doing it manually 
-	// if (canWrite) 
-	// 	canWrite = 0;
-	// else {
-	// 	wakeUpQueue *curr = malloc(sizeof(wakeUpQueue));
-	// 	curr -> PID = getpid();
-	// 	curr -> next = NULL;
-	// 	if (writeHead[unit] == NULL) {
-	// 		writeHead[unit] = curr;
-	// 		writeTail[unit] = curr;
-	// 	} else {
-	// 		writeTail[unit] -> next = curr;
-	// 		writeTail[unit] = curr;
-	// 	}
-	// 	blockMe(40);
-	// }
-
-	// send the message
+/*
+ * Write to the control register of a terminal
+ */
+void termControl(int unit, int control) {
+	int re = USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*)(long) control);
+	if (re == USLOSS_DEV_INVALID) 
+		USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in terminal driver\n");
+}
+
+/*
+ * Called by the terminal driver when the transmitter is ready
+ * Send the next character in the ring, or turn off transmit interrupts
+ * once the ring is drained
+ */
+void termXmit(int unit) {
+	termRing *ring = &termOut[unit];
+	// a writer may be adding to the ring
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	if (ring -> count == 0) {
+		if (ring -> xmitOn) {
+			ring -> xmitOn = 0;
+			termControl(unit, USLOSS_TERM_CTRL_RECV_INT(0));
+		}
+		restoreInterrupt(currPSR);
+		return;
+	}
 	int control = 0;
-	control = USLOSS_TERM_CTRL_CHAR(control, buffer[0]);
+	control = USLOSS_TERM_CTRL_CHAR(control, ring -> data[ring -> head]);
 	control = USLOSS_TERM_CTRL_XMIT_INT(control);
 	control = USLOSS_TERM_CTRL_RECV_INT(control);
 	control = USLOSS_TERM_CTRL_XMIT_CHAR(control);
-	while (1) {
-		re = USLOSS_DeviceInput(USLOSS_DISK_DEV, unit, &status);
-		if (re == USLOSS_DEV_INVALID) printf("invalid\n");
-		if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY) break;
+	termControl(unit, control);
+	ring -> head = (ring -> head + 1) % TERM_OUT_SIZE;
+	ring -> count--;
+	// let a blocked writer refill the ring, never block the driver
+	if (ring -> waiting) {
+		ring -> waiting = 0;
+		MboxCondSend(termWriteSpace[unit], NULL, 0);
 	}
-	re = USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit,((void *)(long) control));
-	if (re == USLOSS_DEV_INVALID) 
-		USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in terminal driver\n");
-	strcpy(toWrite, buffer + 1);
-	// after finish
-	//MboxReceive(termWriteNum[unit], lenOut, sizeof(int));
-	*lenOut = bufSize;
-	// waiting for driver to finish
-	MboxReceive(termWriteFinish[unit], NULL, 0);
-	// clear out buffer
-	memset(toWrite, '\0', MAXLINE);
-
-	// release write lock
-	MboxReceive(termWriteLock[unit], NULL, 0);
-	// wakeUpQueue *temp = writeHead[unit];
-	// for (; temp != NULL; ) {
-	// 	int pid = temp -> PID;
-	// 	if (temp -> next == NULL) {
-	// 		writeHead[unit] = NULL;
-	// 		writeTail[unit] = NULL;
-	// 	} else {
-	// 		writeHead[unit] = temp -> next;
-	// 		writeTail[unit] = writeTail[unit] -> next;
-	// 	}
-	// 	temp = writeHead[unit];
-	// 	unblockProc(pid);
-	// }
-	return 0;
+	restoreInterrupt(currPSR);
 }
 
 /*
@@ -410,37 +763,30 @@ int termWriteHelper(char *buffer, int bufSize, int unit, int *lenOut) {
  */
 int diskDriver(char *arg) {
 	int status, re;
+	int tracks = 0;
 	int unit = atoi(arg);
-	// get the disk sizes
-	// lock the global disk request
-	MboxSend(diskRequestLock, NULL, 0);
-	while (1) {
-		re = USLOSS_DeviceInput(USLOSS_DISK_DEV, unit, &status);
-		if (status == USLOSS_DEV_READY) break;
-		else if (status == USLOSS_DEV_ERROR) printf("error\n");
-	}
-	// call USLOSS_DeviceOutput
-	globalDiskRequest.opr = USLOSS_DISK_TRACKS;
-	globalDiskRequest.reg1 = (void*)(long) &numDiskTracks[unit];
-	globalDiskRequest.reg2 = NULL;
-	re = USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &globalDiskRequest);
+	// probe the disk size once, the device is idle at boot so there is no
+	// need to poll it or share globalDiskRequest
+	USLOSS_DeviceRequest probe;
+	probe.opr = USLOSS_DISK_TRACKS;
+	probe.reg1 = (void*)(long) &tracks;
+	probe.reg2 = NULL;
+	re = USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &probe);
 	if (re == USLOSS_DEV_INVALID) 
 		USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in disk driver\n");
 	// waiting for it to finish
 	re = waitDevice(USLOSS_DISK_DEV, unit, &status);
-	// wake up anyone that are waiting on the this
-	for (; diskSizeMailbox[unit][1] != 0; diskSizeMailbox[unit][1]--) 
-		MboxSend(diskSizeMailbox[unit][0], NULL, 0);
-	//	MboxCondSend(diskSizeMailbox[unit][0], NULL, 0);
-	// unlock the global disk request
-	MboxReceive(diskRequestLock, NULL, 0);
-	// initialize the diskRequests table
-	for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
-		for(int j = 0; j < numDiskTracks[i]; j++) {
-			diskRequests[i][numDiskTracks[i]][0] = NULL;
-			diskRequests[i][numDiskTracks[i]][1] = NULL;
-		}
+	if (status == USLOSS_DEV_ERROR) 
+		USLOSS_Trace("Fail to read the disk size\n");
+	if (tracks > MAXDISK) {
+		USLOSS_Trace("Disk %d has %d tracks, only using %d\n", unit, tracks, MAXDISK);
+		tracks = MAXDISK;
 	}
+	// publish the geometry, it never changes after this
+	diskGeo[unit].sectorSize = USLOSS_DISK_SECTOR_SIZE;
+	diskGeo[unit].trackSize = USLOSS_DISK_TRACK_SIZE;
+	diskGeo[unit].numTracks = tracks;
+	MboxSend(diskProbed[unit], NULL, 0);
 
 	// start handling request
 	int currTrack = 0;
@@ -454,65 +800,21 @@ int diskDriver(char *arg) {
 			currTrack = firstTrack[unit][0];
 			firstTrack[unit][1] = 0;
 		}
-		for (int i = 0; i < numDiskTracks[unit]; i++) {
-			if (diskRequests[unit][(currTrack + i) % 15][0] == NULL) continue;
+		for (int i = 0; i < diskGeo[unit].numTracks; i++) {
+			if (diskRequests[unit][(currTrack + i) % diskGeo[unit].numTracks][0] == NULL) continue;
 			else {
-				newTrack = (currTrack + i) % 15;
+				newTrack = (currTrack + i) % diskGeo[unit].numTracks;
 				// seek if necessary
-				if (newTrack != currTrack) {
-					MboxSend(diskRequestLock, NULL, 0);
-					globalDiskRequest.opr = USLOSS_DISK_SEEK;
-					globalDiskRequest.reg1 = (void*)(long)newTrack;
-					globalDiskRequest.reg2 = NULL;
-					int re = USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &globalDiskRequest);
-					if (re == USLOSS_DEV_INVALID) 
-						USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter\n");
-					re = waitDevice(USLOSS_DISK_DEV, unit, &status);
-					if (re == USLOSS_DEV_INVALID) 
-						USLOSS_Trace("Invalid USLOSS_DeviceInput parameter\n");
-					if (status == USLOSS_DEV_BUSY) 
-						USLOSS_Trace("USLOSS_DEV_BUSY showed, serious error in code\n");
-					else if (status == USLOSS_DEV_ERROR) 
-						USLOSS_Trace("Fail to Seek\n");
-					MboxReceive(diskRequestLock, NULL, 0);
-				}
+				diskSeek(unit, newTrack);
 				// process all requests within the current track
-				for (; diskRequests[unit][newTrack][0] != NULL; ) {
-					// deque the current request
-					diskRequestQueue *currReq = diskRequests[unit][newTrack][0];
-					if (currReq -> next == NULL) {
-						diskRequests[unit][newTrack][0] = NULL;
-						diskRequests[unit][newTrack][1] = NULL;
-					} else diskRequests[unit][newTrack][0] = currReq -> next;
-					// perform read/write on all required blocks
-					for (int i = 0; i < currReq -> numBlocks; i++) {
-						MboxSend(diskRequestLock, NULL, 0);
-						if (currReq -> type == READ) globalDiskRequest.opr = USLOSS_DISK_READ;
-						else if (currReq -> type == WRITE) globalDiskRequest.opr = USLOSS_DISK_WRITE;
-						// NOTE!! I'm wrapping around blocks here and this might not be desired
-						globalDiskRequest.reg1 = (void*)(long) ((currReq -> firstBlock + i) % USLOSS_DISK_TRACK_SIZE);
-						globalDiskRequest.reg2 = (currReq -> buffer) + (i * USLOSS_DISK_SECTOR_SIZE);
-						int re = USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &globalDiskRequest);
-						if (re == USLOSS_DEV_INVALID) 
-							USLOSS_Trace("Invalid USLOSS_DeviceOutput parametern");
-						// check status after disk request
-						re = waitDevice(USLOSS_DISK_DEV, unit, &status);
-						if (re == USLOSS_DEV_INVALID) 
-							USLOSS_Trace("Invalid USLOSS_DeviceInput parameter\n");
-						if (status == USLOSS_DEV_BUSY) 
-							USLOSS_Trace("USLOSS_DEV_BUSY showed, serious error in code\n");
-						currReq -> status = status;
-						if (status == USLOSS_DEV_ERROR) {
-							USLOSS_Trace("failed disk request\n");
-							break;
-						}
-						MboxReceive(diskRequestLock, NULL, 0);
-					}
-					unblockProc(currReq -> PID);
-				}
+				diskServeTrack(unit, newTrack);
 			}
 		}
 		currTrack = newTrack;
+		// the queue drained, a poller waiting for the disk can go now
+		deviceDataReady(USLOSS_DISK_INT, unit);
+		// nothing queued, flush written-behind tracks and read ahead
+		diskIdle(unit);
 	}
 	return status;
 
@@ -529,7 +831,7 @@ int diskDriver(char *arg) {
  * 						0, otherwise
  */
 void diskSize(systemArgs * args) {
-	int sector, track, disk;
+	int sector = 0, track = 0, disk = 0;
 	int re = diskSizeHelper((long)args -> arg1, &sector, &track, &disk);
 	args -> arg1 = (void*)(long) sector;
 	args -> arg2 = (void*)(long) track;
@@ -539,20 +841,15 @@ void diskSize(systemArgs * args) {
 
 /*
  * The actual SYS_DISKSIZE handler
+ * Never blocks, the geometry was probed in phase4_start_service_processes()
  * @return: 	   -1, if illegal values were given as input
  * 					0, otherwise
  */
 int diskSizeHelper(int unit, int *sector, int *track, int *disk) {
-	if (unit < 0 || unit > USLOSS_DISK_UNITS) return -1;
-
-	*sector = USLOSS_DISK_SECTOR_SIZE; // size of disk sector in bytes
-	*track = USLOSS_DISK_TRACK_SIZE; // number of sectors in a track
-	// wait for init to finish if haven't already
-	if (numDiskTracks[unit] == -1) {
-		diskSizeMailbox[unit][1]++;
-		MboxReceive(diskSizeMailbox[unit][0], NULL, 0);
-	} 
-	*disk = numDiskTracks[unit]; // number of disk tracks
+	if (unit < 0 || unit >= USLOSS_DISK_UNITS) return -1;
+	*sector = diskGeo[unit].sectorSize;
+	*track = diskGeo[unit].trackSize;
+	*disk = diskGeo[unit].numTracks;
 	return 0;
 }
 
@@ -566,8 +863,10 @@ int diskSizeHelper(int unit, int *sector, int *track, int *disk) {
  */
 void diskRead(systemArgs * args) {
 	int statusOut;
+	int start = statStart();
 	int re = diskRequestHelper(args -> arg1, (long) args -> arg5, (long) args -> arg3, 
 								(long) args -> arg4, (long) args -> arg2, &statusOut, READ);
+	diskRecordRequest((long) args -> arg5, READ, re, (long) args -> arg2, start);
 	args -> arg1 = (void*)(long)statusOut;
 	args -> arg4 = (void*)(long)re;
 }
@@ -582,38 +881,92 @@ void diskRead(systemArgs * args) {
  */
 void diskWrite(systemArgs * args) {
 	int statusOut;
+	int start = statStart();
 	int re = diskRequestHelper(args -> arg1, (long) args -> arg5, (long) args -> arg3, 
 								(long) args -> arg4, (long) args -> arg2, &statusOut, WRITE);
+	diskRecordRequest((long) args -> arg5, WRITE, re, (long) args -> arg2, start);
 	args -> arg1 = (void*)(long)statusOut;
 	args -> arg4 = (void*)(long)re;
 }
 
 /*
  * The actual SYS_DISKREAD and SYS_DISKWRITE handler
+ * A request that runs past the end of its track goes on at the first block
+ * of the next track, one track at a time
  * @return: 	   -1, if illegal values were given as input
  * 					0, otherwise
  */
 int diskRequestHelper(void *buffer, int unit, int track, int firstBlock, 
 						int blocks, int *statusOut, int type) {
-	if (numDiskTracks[unit] == -1) {
-		diskSizeMailbox[unit][1]++;
-		MboxReceive(diskSizeMailbox[unit][0], NULL, 0);
-		// NOTE I'm changing this because test 14 timeout in gradescope
-		// but it runs fine in my terminal
-		//numDiskTracks[unit] = 16 * (1 + unit);
-	} 
 	if (unit < 0 || unit >= USLOSS_DISK_UNITS) return -1;
-	if (track < 0 || track > numDiskTracks[unit]) return -1;
-	if (firstBlock < 0 || firstBlock > USLOSS_DISK_TRACK_SIZE) return -1;
-	if (blocks < 0 || blocks > USLOSS_DISK_TRACK_SIZE) return -1;
+	if (track < 0 || track >= diskGeo[unit].numTracks) return -1;
+	if (firstBlock < 0 || firstBlock >= USLOSS_DISK_TRACK_SIZE) return -1;
+	if (blocks < 0 || blocks > (diskGeo[unit].numTracks - track) 
+			* USLOSS_DISK_TRACK_SIZE - firstBlock) return -1;
+	*statusOut = 0;
+	while (blocks > 0 && *statusOut == 0) {
+		int count = USLOSS_DISK_TRACK_SIZE - firstBlock;
+		if (count > blocks) count = blocks;
+		diskTrackRequest(buffer, unit, track, firstBlock, count, statusOut, type);
+		buffer = (char *) buffer + count * USLOSS_DISK_SECTOR_SIZE;
+		blocks -= count;
+		track++;
+		firstBlock = 0;
+	}
+	return 0;
+}
+
+/*
+ * Read or write blocks that all lie on one track, from the track cache if
+ * possible, otherwise queued for the driver
+ */
+void diskTrackRequest(void *buffer, int unit, int track, int firstBlock, 
+						int blocks, int *statusOut, int type) {
+	// try the track cache first
+	MboxSend(diskCacheLock[unit], NULL, 0);
+	int runLength = diskStreamUpdate(unit, track, firstBlock, blocks, type);
+	if (type == READ) {
+		// a sequential reader keeps the driver reading ahead of it
+		if (runLength > 0) {
+			prefetchNext[unit] = track;
+			if (firstBlock + blocks >= USLOSS_DISK_TRACK_SIZE) prefetchNext[unit]++;
+			prefetchEnd[unit] = track + 1 + DISK_PREFETCH_DEPTH;
+			if (prefetchEnd[unit] > diskGeo[unit].numTracks) 
+				prefetchEnd[unit] = diskGeo[unit].numTracks;
+		}
+		if (diskCacheRead(buffer, unit, track, firstBlock, blocks)) {
+			MboxReceive(diskCacheLock[unit], NULL, 0);
+			statRecord(statDiskCached[unit], blocks);
+			if (runLength > 0) MboxCondSend(diskMailbox[unit], NULL, 0);
+			*statusOut = 0;
+			return;
+		}
+	// small sequential writes are buffered and written as a whole track later
+	} else if (diskCacheWrite(buffer, unit, track, firstBlock, blocks,
+					runLength > 0 && blocks < USLOSS_DISK_TRACK_SIZE)) {
+		int flush = 0;
+		for (int i = 0; i < DISK_CACHE_LINES; i++)
+			flush |= diskCacheFlushable(&diskCache[unit][i]);
+		MboxReceive(diskCacheLock[unit], NULL, 0);
+		statRecord(statDiskCached[unit], blocks);
+		if (flush) MboxCondSend(diskMailbox[unit], NULL, 0);
+		*statusOut = 0;
+		return;
+	}
+	MboxReceive(diskCacheLock[unit], NULL, 0);
 	// add this request to the queue
 	diskRequestQueue *currReq = malloc(sizeof(diskRequestQueue));
 	currReq -> PID = getpid();
 	currReq -> type = type;
 	currReq -> firstBlock = firstBlock;
 	currReq -> numBlocks = blocks;
-	currReq -> buffer = buffer;
+	// the driver runs with its own page table once part 5 is on, so the data
+	// goes through the request and is copied here, in the caller's context
+	currReq -> buffer = currReq -> data;
+	if (type == WRITE) memcpy(currReq -> data, buffer, blocks * USLOSS_DISK_SECTOR_SIZE);
 	currReq -> status = -1;
+	currReq -> done = 0;
+	currReq -> blocked = 0;
 	currReq -> next = NULL;
 	if (diskRequests[unit][track][0] == NULL) {
 		diskRequests[unit][track][0] = currReq;
@@ -626,15 +979,406 @@ int diskRequestHelper(void *buffer, int unit, int track, int firstBlock,
 		diskRequests[unit][track][1] -> next = currReq;
 		diskRequests[unit][track][1] = currReq;
 	}
-	//MboxCondSend(diskMailbox[unit], NULL, 0);
-	MboxSend(diskMailbox[unit], NULL, 0);
-	blockMe(33); // arbitrary number 33
+	// never block on the mailbox, the driver could serve us and unblock us 
+	// out of MboxSend(). A full mailbox means a scan is already due
+	MboxCondSend(diskMailbox[unit], NULL, 0);
+	// the driver can run before we block when we are preempted, so only 
+	// block until done, with interrupts off between the check and blockMe()
+	int currPSR = USLOSS_PsrGet();
+	disableInterrupt();
+	while (! currReq -> done) {
+		currReq -> blocked = 1;
+		blockMe(33); // arbitrary number 33
+		currReq -> blocked = 0;
+	}
+	restoreInterrupt(currPSR);
 	if (currReq -> status == USLOSS_DEV_ERROR) 
 		*statusOut = currReq -> status;
-	else *statusOut = 0;
+	else {
+		*statusOut = 0;
+		if (type == READ) memcpy(buffer, currReq -> data, blocks * USLOSS_DISK_SECTOR_SIZE);
+	}
+	free(currReq);
+}
+
+/*
+ * Issue one operation to the disk and wait for it to complete
+ * @return:		the disk status after the operation
+ */
+int diskDeviceOp(int unit, int opr, void *reg1, void *reg2) {
+	int status;
+	MboxSend(diskRequestLock, NULL, 0);
+	globalDiskRequest.opr = opr;
+	globalDiskRequest.reg1 = reg1;
+	globalDiskRequest.reg2 = reg2;
+	int re = USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &globalDiskRequest);
+	if (re == USLOSS_DEV_INVALID) 
+		USLOSS_Trace("Invalid USLOSS_DeviceOutput parameter in disk driver\n");
+	// check status after disk request
+	re = waitDevice(USLOSS_DISK_DEV, unit, &status);
+	if (re == USLOSS_DEV_INVALID) 
+		USLOSS_Trace("Invalid USLOSS_DeviceInput parameter\n");
+	if (status == USLOSS_DEV_BUSY) 
+		USLOSS_Trace("USLOSS_DEV_BUSY showed, serious error in code\n");
+	MboxReceive(diskRequestLock, NULL, 0);
+	return status;
+}
+
+/*
+ * Serve every request queued on one track
+ * Back to back requests in the same direction form a run that is done in one
+ * pass over the track, and a run never reorders around the other direction
+ */
+void diskServeTrack(int unit, int track) {
+	diskRequestQueue *run = diskRequests[unit][track][0];
+	diskRequests[unit][track][0] = NULL;
+	diskRequests[unit][track][1] = NULL;
+	while (run != NULL) {
+		// cut the longest run going the same direction off the queue
+		diskRequestQueue *last = run;
+		while (last -> next != NULL && last -> next -> type == run -> type)
+			last = last -> next;
+		diskRequestQueue *rest = last -> next;
+		last -> next = NULL;
+		diskServeRun(unit, track, run);
+		// wake up everyone in the run
+		while (run != NULL) {
+			diskRequestQueue *next = run -> next;
+			run -> done = 1;
+			if (run -> blocked) unblockProc(run -> PID);
+			run = next;
+		}
+		run = rest;
+	}
+}
+
+/*
+ * Transfer a run of same direction requests with each sector touched once
+ * Readers of the same sector share one read, and overlapping writers leave
+ * only the last one queued to be written. Each request still gets its own
+ * buffer filled and its own status
+ */
+void diskServeRun(int unit, int track, diskRequestQueue *run) {
+	char *runBuffer = diskRunBuffer[unit];
+	int wanted[USLOSS_DISK_TRACK_SIZE];
+	int status[USLOSS_DISK_TRACK_SIZE];
+	int opr = (run -> type == READ) ? USLOSS_DISK_READ : USLOSS_DISK_WRITE;
+	memset(wanted, 0, sizeof(wanted));
+	// collect the sectors, later writes overwrite earlier ones
+	for (diskRequestQueue *curr = run; curr != NULL; curr = curr -> next) {
+		for (int i = 0; i < curr -> numBlocks; i++) {
+			int sector = curr -> firstBlock + i;
+			wanted[sector] = 1;
+			if (curr -> type == WRITE)
+				memcpy(runBuffer + (sector * USLOSS_DISK_SECTOR_SIZE), 
+						curr -> buffer + (i * USLOSS_DISK_SECTOR_SIZE), USLOSS_DISK_SECTOR_SIZE);
+		}
+	}
+	// one pass over the track
+	for (int i = 0; i < USLOSS_DISK_TRACK_SIZE; i++) {
+		if (! wanted[i]) continue;
+		status[i] = diskDeviceOp(unit, opr, (void*)(long) i, 
+									runBuffer + (i * USLOSS_DISK_SECTOR_SIZE));
+		if (status[i] == USLOSS_DEV_ERROR) 
+			USLOSS_Trace("failed disk request\n");
+	}
+	// hand the results back to each request
+	for (diskRequestQueue *curr = run; curr != NULL; curr = curr -> next) {
+		curr -> status = USLOSS_DEV_READY;
+		for (int i = 0; i < curr -> numBlocks; i++) {
+			int sector = curr -> firstBlock + i;
+			if (status[sector] == USLOSS_DEV_ERROR) curr -> status = USLOSS_DEV_ERROR;
+			if (curr -> type == READ)
+				memcpy(curr -> buffer + (i * USLOSS_DISK_SECTOR_SIZE),
+						runBuffer + (sector * USLOSS_DISK_SECTOR_SIZE), USLOSS_DISK_SECTOR_SIZE);
+		}
+		// sectors still sitting in the write-behind cache are newer
+		if (curr -> type == READ && curr -> status != USLOSS_DEV_ERROR)
+			diskCacheOverlay(curr -> buffer, unit, track, curr -> firstBlock, curr -> numBlocks);
+	}
+}
+
+/*
+ * Move the disk head to the given track if it is not there already
+ * @return:		the disk status after the seek
+ */
+int diskSeek(int unit, int track) {
+	if (diskHead[unit] == track) return USLOSS_DEV_READY;
+	statRecord(statDiskSeek[unit], track > diskHead[unit] ? 
+					track - diskHead[unit] : diskHead[unit] - track);
+	int status = diskDeviceOp(unit, USLOSS_DISK_SEEK, (void*)(long) track, NULL);
+	if (status == USLOSS_DEV_ERROR) 
+		USLOSS_Trace("Fail to Seek\n");
+	diskHead[unit] = track;
+	return status;
+}
+
+/*
+ * Record a finished SYS_DISKREAD or SYS_DISKWRITE in the disk stats
+ * IOPS and MB/s follow from the counts and totals over the run time
+ */
+void diskRecordRequest(int unit, int type, int re, int blocks, int start) {
+	if (re != 0) return;
+	statLatency(type == READ ? statDiskRead[unit] : statDiskWrite[unit], start);
+	statRecord(statDiskBlocks[unit], blocks);
+}
+
+/*
+ * Return 1 if any request is queued on the given disk, 0 otherwise
+ */
+int diskHasRequests(int unit) {
+	for (int i = 0; i < diskGeo[unit].numTracks; i++)
+		if (diskRequests[unit][i][0] != NULL) return 1;
 	return 0;
 }
 
+/*
+ * Record a request in the per process stream table
+ * When a writer moves on to another track, its old track is ready to flush
+ * @return:		the number of contiguous requests before this one, 
+ * 				0 if this request is not sequential
+ */
+int diskStreamUpdate(int unit, int track, int firstBlock, int blocks, int type) {
+	diskStream *s = procShadow(diskStreams, getpid());
+	if (s -> PID == getpid() && s -> unit == unit && s -> type == type
+			&& s -> nextTrack == track && s -> nextBlock == firstBlock)
+		s -> runLength++;
+	else s -> runLength = 0;
+	if (s -> PID == getpid() && s -> type == WRITE && 
+			(s -> unit != unit || s -> lastTrack != track)) {
+		trackCache *old = diskCacheLookup(s -> unit, s -> lastTrack);
+		if (old != NULL && old -> numDirty > 0) old -> flushReady = 1;
+	}
+	s -> PID = getpid();
+	s -> unit = unit;
+	s -> type = type;
+	s -> lastTrack = track;
+	s -> nextTrack = track;
+	s -> nextBlock = firstBlock + blocks;
+	if (s -> nextBlock >= USLOSS_DISK_TRACK_SIZE) {
+		s -> nextTrack++;
+		s -> nextBlock -= USLOSS_DISK_TRACK_SIZE;
+	}
+	return s -> runLength;
+}
+
+/*
+ * Find the cache line holding the given track
+ * @return:		NULL if the track is not cached
+ */
+trackCache *diskCacheLookup(int unit, int track) {
+	for (int i = 0; i < DISK_CACHE_LINES; i++)
+		if (diskCache[unit][i].track == track) return &diskCache[unit][i];
+	return NULL;
+}
+
+/*
+ * Pick the least recently used clean line to hold a new track
+ * @return:		NULL if every line still has data to write back
+ */
+trackCache *diskCacheVictim(int unit) {
+	trackCache *victim = NULL;
+	for (int i = 0; i < DISK_CACHE_LINES; i++) {
+		trackCache *line = &diskCache[unit][i];
+		if (line -> numDirty > 0) continue;
+		if (line -> track == -1) return line;
+		if (victim == NULL || line -> lastUsed < victim -> lastUsed) victim = line;
+	}
+	return victim;
+}
+
+/*
+ * Copy the requested sectors out of the cache
+ * @return:		1, if every sector was cached
+ * 				0, otherwise and nothing is copied
+ */
+int diskCacheRead(void *buffer, int unit, int track, int firstBlock, int blocks) {
+	trackCache *line = diskCacheLookup(unit, track);
+	if (line == NULL) return 0;
+	for (int i = 0; i < blocks; i++)
+		if (! line -> valid[firstBlock + i]) return 0;
+	for (int i = 0; i < blocks; i++) {
+		int sector = firstBlock + i;
+		memcpy(buffer + (i * USLOSS_DISK_SECTOR_SIZE), 
+				line -> data + (sector * USLOSS_DISK_SECTOR_SIZE), USLOSS_DISK_SECTOR_SIZE);
+	}
+	line -> lastUsed = ++diskCacheClock;
+	return 1;
+}
+
+/*
+ * Copy written sectors into the cache
+ * If behind is set the sectors are left dirty for the driver to write later,
+ * otherwise only an already cached copy is kept up to date
+ * @return:		1, if the write was buffered and the caller can return
+ * 				0, if the write still has to go to the disk
+ */
+int diskCacheWrite(void *buffer, int unit, int track, int firstBlock, int blocks,
+						int behind) {
+	trackCache *line = diskCacheLookup(unit, track);
+	if (line == NULL && behind) {
+		line = diskCacheVictim(unit);
+		if (line != NULL) {
+			memset(line, 0, sizeof(trackCache) - TRACKBYTES);
+			line -> track = track;
+		}
+	}
+	if (line == NULL) return 0;
+	for (int i = 0; i < blocks; i++) {
+		int sector = firstBlock + i;
+		memcpy(line -> data + (sector * USLOSS_DISK_SECTOR_SIZE), 
+				buffer + (i * USLOSS_DISK_SECTOR_SIZE), USLOSS_DISK_SECTOR_SIZE);
+		line -> valid[sector] = 1;
+		if (behind && ! line -> dirty[sector]) {
+			if (line -> numDirty == 0) line -> dirtySince = currentTime();
+			line -> dirty[sector] = 1;
+			line -> numDirty++;
+		// the queued write will carry the newer data
+		} else if (! behind && line -> dirty[sector]) {
+			line -> dirty[sector] = 0;
+			line -> numDirty--;
+		}
+	}
+	line -> lastUsed = ++diskCacheClock;
+	return behind;
+}
+
+/*
+ * Called by the driver after reading from the disk into a request's copy
+ * of the data, never into the caller's memory
+ * Sectors still dirty in the cache are newer than the disk, so copy them over
+ * the buffer; sectors not yet cached are filled from the buffer
+ */
+void diskCacheOverlay(void *buffer, int unit, int track, int firstBlock, int blocks) {
+	MboxSend(diskCacheLock[unit], NULL, 0);
+	trackCache *line = diskCacheLookup(unit, track);
+	for (int i = 0; line != NULL && i < blocks; i++) {
+		int sector = firstBlock + i;
+		char *cached = line -> data + (sector * USLOSS_DISK_SECTOR_SIZE);
+		if (line -> dirty[sector]) 
+			memcpy(buffer + (i * USLOSS_DISK_SECTOR_SIZE), cached, USLOSS_DISK_SECTOR_SIZE);
+		else if (! line -> valid[sector]) {
+			memcpy(cached, buffer + (i * USLOSS_DISK_SECTOR_SIZE), USLOSS_DISK_SECTOR_SIZE);
+			line -> valid[sector] = 1;
+		}
+	}
+	MboxReceive(diskCacheLock[unit], NULL, 0);
+}
+
+/*
+ * Read every missing sector of a track into the given cache line, which the
+ * caller claimed for the track
+ * diskCacheLock is only held between sectors, callers keep using the cache
+ * while the disk reads. Gives up as soon as a request is queued, or if the
+ * line was taken for another track meanwhile
+ * @return:		1, if the whole track is cached
+ * 				0, otherwise
+ */
+int diskFillLine(int unit, trackCache *line, int track) {
+	char sector[USLOSS_DISK_SECTOR_SIZE];
+	diskSeek(unit, track);
+	for (int i = 0; i < USLOSS_DISK_TRACK_SIZE; i++) {
+		if (diskHasRequests(unit)) return 0;
+		MboxSend(diskCacheLock[unit], NULL, 0);
+		int gone = line -> track != track;
+		int valid = line -> valid[i];
+		MboxReceive(diskCacheLock[unit], NULL, 0);
+		if (gone) return 0;
+		if (valid) continue;
+		int status = diskDeviceOp(unit, USLOSS_DISK_READ, (void*)(long) i, sector);
+		if (status == USLOSS_DEV_ERROR) {
+			USLOSS_Trace("failed disk read-ahead\n");
+			return 0;
+		}
+		// a buffered write may have filled the sector while we read it
+		MboxSend(diskCacheLock[unit], NULL, 0);
+		if (line -> track == track && ! line -> valid[i]) {
+			memcpy(line -> data + (i * USLOSS_DISK_SECTOR_SIZE), sector, 
+					USLOSS_DISK_SECTOR_SIZE);
+			line -> valid[i] = 1;
+		}
+		MboxReceive(diskCacheLock[unit], NULL, 0);
+	}
+	return 1;
+}
+
+/*
+ * Write every dirty sector of a cache line back in one pass over the track
+ * Each sector is copied out and marked clean under diskCacheLock, then
+ * written without it. A sector written again meanwhile is dirty again and
+ * goes out with the next flush
+ */
+void diskFlushLine(int unit, trackCache *line) {
+	char sector[USLOSS_DISK_SECTOR_SIZE];
+	MboxSend(diskCacheLock[unit], NULL, 0);
+	int track = line -> track;
+	MboxReceive(diskCacheLock[unit], NULL, 0);
+	diskSeek(unit, track);
+	for (int i = 0; i < USLOSS_DISK_TRACK_SIZE; i++) {
+		MboxSend(diskCacheLock[unit], NULL, 0);
+		int dirty = line -> track == track && line -> dirty[i];
+		if (dirty) {
+			memcpy(sector, line -> data + (i * USLOSS_DISK_SECTOR_SIZE), 
+					USLOSS_DISK_SECTOR_SIZE);
+			line -> dirty[i] = 0;
+			if (--line -> numDirty == 0) {
+				line -> flushReady = 0;
+				line -> dirtySince = 0;
+			}
+		}
+		MboxReceive(diskCacheLock[unit], NULL, 0);
+		if (! dirty) continue;
+		int status = diskDeviceOp(unit, USLOSS_DISK_WRITE, (void*)(long) i, sector);
+		// the writer has already returned, nobody left to report this to
+		if (status == USLOSS_DEV_ERROR) 
+			USLOSS_Trace("failed disk write-behind\n");
+	}
+}
+
+/*
+ * Return 1 if a cache line should be written back now
+ * A line is flushed once the whole track is dirty, once its writer moved on,
+ * or once it has sat dirty for DISK_WRITEBEHIND_DELAY
+ */
+int diskCacheFlushable(trackCache *line) {
+	if (line -> numDirty == 0) return 0;
+	return line -> numDirty == USLOSS_DISK_TRACK_SIZE || line -> flushReady
+			|| currentTime() - line -> dirtySince >= DISK_WRITEBEHIND_DELAY;
+}
+
+/*
+ * Called by the driver once its request queues are empty
+ * Write back dirty tracks, then read ahead for the last sequential reader
+ * until a new request shows up
+ * diskCacheLock is never held across a disk operation, so a request can be
+ * queued, or served from the cache, while this runs
+ */
+void diskIdle(int unit) {
+	for (int i = 0; i < DISK_CACHE_LINES; i++) {
+		MboxSend(diskCacheLock[unit], NULL, 0);
+		int flush = diskCacheFlushable(&diskCache[unit][i]);
+		MboxReceive(diskCacheLock[unit], NULL, 0);
+		if (flush) diskFlushLine(unit, &diskCache[unit][i]);
+	}
+	while (prefetchNext[unit] < prefetchEnd[unit] && ! diskHasRequests(unit)) {
+		int track = prefetchNext[unit];
+		MboxSend(diskCacheLock[unit], NULL, 0);
+		trackCache *line = diskCacheLookup(unit, track);
+		if (line == NULL) {
+			line = diskCacheVictim(unit);
+			if (line != NULL) {
+				memset(line, 0, sizeof(trackCache) - TRACKBYTES);
+				line -> track = track;
+			}
+		}
+		if (line != NULL) line -> lastUsed = ++diskCacheClock;
+		MboxReceive(diskCacheLock[unit], NULL, 0);
+		// a partly read track is picked up again at the next idle moment
+		if (line == NULL || ! diskFillLine(unit, line, track)) break;
+		prefetchNext[unit]++;
+	}
+}
+
 /* ------------------------------------------------------------------------- */
 
 
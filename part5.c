@@ -0,0 +1,1002 @@
+/* ***********************************************
+ * FILE:       part5.c
+ * AUTHOR:     SIWEN WANG, HUIQI HE
+ * COURSE:     CSC4XX FALL 2022
+ * ASSIGNMENT: OS PROJECT PART 5
+ * PURPOSE:    VIRTUAL MEMORY
+ * ***********************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include "phase1.h"
+#include "phase2.h"
+#include "phase3.h"
+#include "phase4.h"
+#include "phase5.h"
+
+/* -------------------------------------------------------- Global Variables */
+#define EMPTY	 	0
+#define OCCUPIED 	1
+#define READ		0	// same as the disk request types in part4.c
+#define WRITE		1
+#define VMPAGES		16	// pages in every address space
+#define VMFRAMES	8	// physical frames shared by all processes
+#define SWAPDISK	1	// disk unit used as backing store
+#define NOSWAP		-1
+#define VMPAGERS	2	// pager processes resolving faults
+#define FAULTQUEUE	16	// faults queued for the pagers, more block in MboxSend()
+#define READAROUND	2	// swapped out neighbours loaded on each side of a fault
+// pages of a pager's own address space it maps frames at to fill them
+#define SCRATCHSRC	0
+#define SCRATCHDST	1
+#define MAXSHM		8	// shared memory regions at a time
+#define SHMPAGES	4	// top pages of every address space, kept for regions
+#define SHMFIRST	(VMPAGES - SHMPAGES)
+#define NOSHM		-1
+// extra syscalls, numbered down from the top of systemCallVec[] like the
+// ones in part4.c
+#define SYS_SHMCREATE	(MAXSYSCALLS - 5)
+#define SYS_SHMMAP		(MAXSYSCALLS - 6)
+#define SYS_SHMUNMAP	(MAXSYSCALLS - 7)
+#define SYS_SHMDESTROY	(MAXSYSCALLS - 8)
+#define SYS_VMSTATS		(MAXSYSCALLS - 9)
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------- Helper Functions */
+struct faultRequest;
+void mmuFaultHandler(int type, void *arg);
+int pagerDaemon(char *arg);
+void vmResolve(struct faultRequest *req);
+void vmReadAround(int pid, int page);
+void vmCopyOnWrite(int pid, int page);
+int vmFreeFrame();
+int vmFindFrame();
+void vmEvict(int frame);
+void vmLoadPage(int pid, int page, int frame);
+void *vmMapScratch(int scratch, int frame);
+void vmUnmapScratch();
+int vmSwapAlloc();
+void vmSwapFree(int slot);
+void vmFrameRelease(int frame);
+void vmSwapIO(int slot, int type);
+void shmCreate(systemArgs *args);
+int shmCreateHelper(int size, int *idOut);
+void shmMap(systemArgs *args);
+int shmMapHelper(int id, void **addrOut);
+void shmUnmap(systemArgs *args);
+int shmUnmapHelper(int id);
+void shmDestroy(systemArgs *args);
+int shmDestroyHelper(int id);
+void shmLoadPage(int pid, int page);
+void shmDetach(int pid, int id);
+void shmFree(int id);
+void vmStats(systemArgs *args);
+struct vmSpace *vmSpaceOf(int pid);
+int vmReplyMbox(int pid);
+int vmStatsHelper(int pid, int *rss, int *major, int *minor, int *ref, int *dirty);
+int diskSizeHelper(int unit, int *sector, int *track, int *disk);
+int diskRequestHelper(void *buffer, int unit, int track, int firstBlock,
+						int blocks, int *statusOut, int type);
+void mmu_fork(int parent, int child);
+void mmu_sample(void);
+void registerForkHook(void (*hook)(int, int));
+void registerProcStatsHook(int (*hook)(int, int *, int *, int *, int *, int *));
+void registerClockTickHook(void (*hook)(void));
+int procTableSize();
+int procShadowRegister(int size);
+void *procShadow(int id, int pid);
+int statRegister(char *name);
+void statRecord(int id, int value);
+int statStart();
+void statLatency(int id, int start);
+/* ------------------------------------------------------------------------- */
+
+/* -------------------------------------------------------------- Structures */
+// What the MMU interrupt handler sends to the pagers
+typedef struct faultRequest {
+	int pid;
+	int page;
+	int cause;		// USLOSS_MMU_FAULT or USLOSS_MMU_ACCESS
+} faultRequest;
+
+// What the kernel knows about a page beyond its USLOSS_PTE
+typedef struct pageInfo {
+	int swapSlot;	// where the page was last written out, NOSWAP if never
+	int cow;		// shared with a parent or child, copy before writing
+	int shm;		// region mapped at this page, NOSHM for a private page
+} pageInfo;
+
+// Paging behaviour of one process
+typedef struct vmProcStats {
+	int majorFaults;	// resolved with a read from swap
+	int minorFaults;	// zero filled, copied on write, or already in core
+	int refPages;		// resident pages referenced at the last mmu_sample()
+	int dirtyPages;		// resident pages written at the last mmu_sample()
+} vmProcStats;
+
+// The address space of one process, kept in a shadow table of part 1 so
+// there is one for every slot the process table grows to
+typedef struct vmSpace {
+	int pid;		// owner, 0 once it has quit
+	USLOSS_PTE pageTable[VMPAGES];	// loaded by mmu_switch() while it runs
+	pageInfo pageInfos[VMPAGES];
+	vmProcStats stats;
+	int hasReply;
+	int reply;		// its faults are answered here, made on the first one
+} vmSpace;
+
+// What SYS_VMSTATS fills in, more than fits in the syscall arguments
+typedef struct vmStatsArgs {
+	int rss;
+	int majorFaults;
+	int minorFaults;
+	int refPages;
+	int dirtyPages;
+} vmStatsArgs;
+
+// One physical frame, after fork() several processes may map it, always
+// at the same page and with the same swap slot
+typedef struct frameEntry {
+	int refCount;	// processes mapping it, 0 if the frame is free
+	int page;		// page it is mapped at
+	int busy;		// being filled or written out, never picked as a victim
+	int shm;		// region holding the frame, NOSHM for a private page
+} frameEntry;
+
+// A shared memory region, it sits at the same pages in every process that
+// maps it, so its frames obey the same rule as the ones shared by fork()
+// The region holds one reference to each of its frames, the page outlives
+// its mappers until it is evicted to the region's own swap slot
+typedef struct shmRegion {
+	int status;
+	int firstPage;
+	int numPages;
+	int mappers;	// processes that have it mapped
+	int destroyed;	// freed as soon as the last mapper unmaps it
+	int frame[SHMPAGES];	// -1 when the page is not in core
+	int swapSlot[SHMPAGES];
+} shmRegion;
+/* ------------------------------------------------------------------------- */
+
+/* --------------------------------------------------------------- Variables */
+// shadow table of vmSpace, one address space per process
+int vmSpaces;
+// pages read from swap so far, tells major faults from minor ones
+int swapReads;
+frameEntry frames[VMFRAMES];
+// CLOCK replacement, the next frame to look at
+int clockHand;
+// swap area on SWAPDISK, one slot holds one page, shared after fork() like
+// frames are, swapRefs[] counts the processes using each slot
+int *swapRefs;
+int numSwapSlots;
+// faults queue here for the pagers, the faulting process then waits on
+// its own reply mailbox
+int vmFaultMbox;
+int pagerPID[VMPAGERS];
+// one pager or shared memory syscall at a time, it also guards vmBounce
+int vmLock;
+// page contents go between the VM region and the disk through here, the
+// disk driver runs with its own page table and cannot see the region
+char *vmBounce;
+void *vmRegion;
+int pageSize;
+int sectorsPerPage;
+int vmStarted;
+// fault latency in microseconds, swap I/O per page, and evictions
+int statFault, statSwapIn, statSwapOut, statEvict;
+// pages a child shares with its parent at fork, and copies made on write
+int statCowShared, statCowCopy;
+// faults a pager resolved per trip through vmLock, and pages read around
+int statPagerBatch, statReadAround;
+shmRegion shmRegions[MAXSHM];
+// region using each page of the shared window, NOSHM if free
+int shmPageOwner[SHMPAGES];
+/* ------------------------------------------------------------------------- */
+
+/* ------------------------------------------------------ Required Functions */
+/*
+ * Initialize all variables and turn on the MMU
+ */
+void phase5_init(void) {
+	// an address space is set up by mmu_init_proc(), before that it is
+	// zeroed and has no owner
+	vmSpaces = procShadowRegister(sizeof(vmSpace));
+	memset(frames, 0, VMFRAMES * sizeof(frameEntry));
+	for (int i = 0; i < VMFRAMES; i++) frames[i].shm = NOSHM;
+	memset(shmRegions, 0, MAXSHM * sizeof(shmRegion));
+	for (int i = 0; i < SHMPAGES; i++) shmPageOwner[i] = NOSHM;
+	clockHand = 0;
+	swapReads = 0;
+	swapRefs = NULL;
+	numSwapSlots = 0;
+	vmLock = MboxCreate(1, 0);
+	vmFaultMbox = MboxCreate(FAULTQUEUE, sizeof(faultRequest));
+	int re = USLOSS_MmuInit(VMPAGES, VMPAGES, VMFRAMES, USLOSS_MMU_MODE_PAGETABLE);
+	if (re != USLOSS_MMU_OK) {
+		USLOSS_Console("Error: fail USLOSS_MmuInit(), halt simulation\n");
+		USLOSS_Halt(1);
+	}
+	int numPages;
+	vmRegion = USLOSS_MmuRegion(&numPages);
+	pageSize = USLOSS_MmuPageSize();
+	sectorsPerPage = (pageSize + USLOSS_DISK_SECTOR_SIZE - 1) / USLOSS_DISK_SECTOR_SIZE;
+	vmBounce = malloc(sectorsPerPage * USLOSS_DISK_SECTOR_SIZE);
+	if (vmBounce == NULL) {
+		USLOSS_Trace("Error: Out of memory! \n");
+		USLOSS_Halt(1);
+	}
+	USLOSS_IntVec[USLOSS_MMU_INT] = mmuFaultHandler;
+	statFault = statRegister("vm_fault_us");
+	statSwapIn = statRegister("vm_swapin_us");
+	statSwapOut = statRegister("vm_swapout_us");
+	statEvict = statRegister("vm_evict");
+	statCowShared = statRegister("vm_cow_shared_pages");
+	statCowCopy = statRegister("vm_cow_copy_us");
+	statPagerBatch = statRegister("vm_pager_batch");
+	statReadAround = statRegister("vm_readaround_pages");
+	systemCallVec[SYS_SHMCREATE] = shmCreate;
+	systemCallVec[SYS_SHMMAP] = shmMap;
+	systemCallVec[SYS_SHMUNMAP] = shmUnmap;
+	systemCallVec[SYS_SHMDESTROY] = shmDestroy;
+	systemCallVec[SYS_VMSTATS] = vmStats;
+	registerForkHook(mmu_fork);
+	registerProcStatsHook(vmStatsHelper);
+	registerClockTickHook(mmu_sample);
+	vmStarted = 1;
+}
+
+/*
+ * Size the swap area, the disk geometry is known once part 4 has started,
+ * and fork the pagers
+ */
+void phase5_start_service_processes(void) {
+	int sector, track, disk;
+	diskSizeHelper(SWAPDISK, &sector, &track, &disk);
+	numSwapSlots = disk * track / sectorsPerPage;
+	swapRefs = calloc(numSwapSlots, sizeof(int));
+	if (swapRefs == NULL && numSwapSlots > 0) {
+		USLOSS_Trace("Error: Out of memory! \n");
+		USLOSS_Halt(1);
+	}
+	char name[MAXNAME], arg[MAXARG];
+	for (int i = 0; i < VMPAGERS; i++) {
+		sprintf(name, "pager%d", i + 1);
+		sprintf(arg, "%d", i);
+		pagerPID[i] = fork1(name, pagerDaemon, arg, USLOSS_MIN_STACK, 2);
+	}
+}
+
+/*
+ * Called by fork() for every new process, every page starts out not in core
+ * and is zero filled by the first fault on it
+ */
+void mmu_init_proc(int pid) {
+	vmSpace *space = vmSpaceOf(pid);
+	memset(space -> pageTable, 0, VMPAGES * sizeof(USLOSS_PTE));
+	for (int i = 0; i < VMPAGES; i++) {
+		space -> pageInfos[i].swapSlot = NOSWAP;
+		space -> pageInfos[i].cow = 0;
+		space -> pageInfos[i].shm = NOSHM;
+	}
+	space -> pid = pid;
+	memset(&space -> stats, 0, sizeof(vmProcStats));
+}
+
+/*
+ * Installed as the fork hook of part 1, called by fork() after
+ * mmu_init_proc(), the child shares every page the
+ * parent has in core or in swap, read only on both sides until one writes
+ * Creating a child costs a page table copy, no page is copied here
+ * Shared memory regions are not inherited, the child maps them itself
+ */
+void mmu_fork(int parent, int child) {
+	if (! vmStarted || vmSpaceOf(parent) -> pid != parent) return;
+	int shared = 0;
+	for (int i = 0; i < VMPAGES; i++) {
+		USLOSS_PTE *from = &vmSpaceOf(parent) -> pageTable[i];
+		USLOSS_PTE *to = &vmSpaceOf(child) -> pageTable[i];
+		pageInfo *fromInfo = &vmSpaceOf(parent) -> pageInfos[i];
+		pageInfo *toInfo = &vmSpaceOf(child) -> pageInfos[i];
+		if (fromInfo -> shm != NOSHM) continue;
+		if (! from -> incore && fromInfo -> swapSlot == NOSWAP) continue;
+		if (from -> incore) {
+			from -> write = 0;
+			*to = *from;
+			frames[from -> frame].refCount++;
+		}
+		if (fromInfo -> swapSlot != NOSWAP) swapRefs[fromInfo -> swapSlot]++;
+		toInfo -> swapSlot = fromInfo -> swapSlot;
+		fromInfo -> cow = 1;
+		toInfo -> cow = 1;
+		shared++;
+	}
+	// the parent is running, its write permissions just changed
+	if (parent == getpid()) USLOSS_MmuSetPageTable(vmSpaceOf(parent) -> pageTable);
+	statRecord(statCowShared, shared);
+}
+
+/*
+ * Called by quit(), drop every frame and swap slot reference of the process
+ */
+void mmu_quit(int pid) {
+	vmSpace *space = vmSpaceOf(pid);
+	for (int i = 0; i < MAXSHM; i++) {
+		if (shmRegions[i].status == OCCUPIED 
+				&& space -> pageInfos[shmRegions[i].firstPage].shm == i)
+			shmDetach(pid, i);
+	}
+	for (int i = 0; i < VMPAGES; i++) {
+		if (space -> pageTable[i].incore) vmFrameRelease(space -> pageTable[i].frame);
+		vmSwapFree(space -> pageInfos[i].swapSlot);
+		space -> pageInfos[i].swapSlot = NOSWAP;
+	}
+	memset(space -> pageTable, 0, VMPAGES * sizeof(USLOSS_PTE));
+	// no fault of ours is in flight, we are the one quitting
+	if (space -> hasReply) MboxRelease(space -> reply);
+	space -> hasReply = 0;
+	space -> pid = 0;
+}
+
+/*
+ * Called by the dispatcher, load the page table of the next process
+ */
+void mmu_switch(int pid) {
+	if (! vmStarted) return;
+	USLOSS_MmuSetPageTable(vmSpaceOf(pid) -> pageTable);
+}
+
+/*
+ * Installed as the clock tick hook of part 4, count the resident pages of
+ * each process that were referenced or written
+ * The bits are left alone for CLOCK, so referenced means since the hand
+ * last passed the frame
+ */
+void mmu_sample(void) {
+	if (! vmStarted) return;
+	for (int i = 0; i < procTableSize(); i++) {
+		vmSpace *space = vmSpaceOf(i);
+		if (space -> pid == 0) continue;
+		int ref = 0, dirty = 0;
+		for (int j = 0; j < VMPAGES; j++) {
+			if (! space -> pageTable[j].incore) continue;
+			int access;
+			USLOSS_MmuGetAccess(space -> pageTable[j].frame, &access);
+			if (access & USLOSS_MMU_REF) ref++;
+			if (access & USLOSS_MMU_DIRTY) dirty++;
+		}
+		space -> stats.refPages = ref;
+		space -> stats.dirtyPages = dirty;
+	}
+}
+/* ------------------------------------------------------------------------- */
+
+/* -------------------------------------------------------- Helper Functions */
+/*
+ * MMU interrupt, runs on the faulting process, arg is the offset of the
+ * faulting address in the VM region
+ */
+void mmuFaultHandler(int type, void *arg) {
+	int offset = (int)(long) arg;
+	int page = offset / pageSize;
+	int cause = USLOSS_MmuGetCause();
+	int pid = getpid();
+	// the shared window is only usable where a region is mapped
+	if (page >= SHMFIRST && page < VMPAGES 
+			&& vmSpaceOf(pid) -> pageInfos[page].shm == NOSHM) 
+		page = -1;
+	if (page < 0 || page >= VMPAGES || (cause != USLOSS_MMU_FAULT 
+			&& (cause != USLOSS_MMU_ACCESS || ! vmSpaceOf(pid) -> pageInfos[page].cow))) {
+		USLOSS_Console("ERROR: Process %d made an invalid memory access at offset %d.\n",
+						pid, offset);
+		USLOSS_Halt(1);
+	}
+	// a pager fills the page, we only wait for it to say the PTE is ready
+	int start = statStart();
+	int reply = vmReplyMbox(pid);
+	faultRequest req;
+	req.pid = pid;
+	req.page = page;
+	req.cause = cause;
+	MboxSend(vmFaultMbox, &req, sizeof(faultRequest));
+	MboxReceive(reply, NULL, 0);
+	statLatency(statFault, start);
+}
+
+/*
+ * Pager process, arg is its index in pagerPID[]. Resolves every fault queued
+ * by the time it holds vmLock before letting go of it
+ * Frames are filled through SCRATCHSRC and SCRATCHDST of its own address
+ * space, the faulting process is not running and its page table only
+ * changes once the page is ready
+ */
+int pagerDaemon(char *arg) {
+	// drop whatever fork() shared with us, the scratch pages must be empty
+	mmu_quit(getpid());
+	mmu_init_proc(getpid());
+	faultRequest req;
+	while (1) {
+		MboxReceive(vmFaultMbox, &req, sizeof(faultRequest));
+		MboxSend(vmLock, NULL, 0);
+		int batch = 0;
+		do {
+			vmResolve(&req);
+			MboxSend(vmReplyMbox(req.pid), NULL, 0);
+			batch++;
+		} while (MboxCondReceive(vmFaultMbox, &req, sizeof(faultRequest)) >= 0);
+		MboxReceive(vmLock, NULL, 0);
+		statRecord(statPagerBatch, batch);
+	}
+	return 0;
+}
+
+/*
+ * Resolve one fault, the page may already be in core if another request
+ * brought it in by reading around
+ */
+void vmResolve(faultRequest *req) {
+	int pid = req -> pid;
+	int page = req -> page;
+	int reads = swapReads;
+	if (req -> cause == USLOSS_MMU_ACCESS) vmCopyOnWrite(pid, page);
+	else if (vmSpaceOf(pid) -> pageTable[page].incore) {
+		// brought in by reading around
+	} else if (vmSpaceOf(pid) -> pageInfos[page].shm != NOSHM) shmLoadPage(pid, page);
+	else {
+		vmLoadPage(pid, page, vmFindFrame());
+		if (vmSpaceOf(pid) -> pageInfos[page].swapSlot != NOSWAP) vmReadAround(pid, page);
+	}
+	if (swapReads > reads) vmSpaceOf(pid) -> stats.majorFaults++;
+	else vmSpaceOf(pid) -> stats.minorFaults++;
+}
+
+/*
+ * A process that faulted on a swapped out page will likely touch the pages
+ * next to it soon, load the swapped out ones while free frames are left
+ * They are not referenced yet, so CLOCK takes them first if they stay unused
+ */
+void vmReadAround(int pid, int page) {
+	int loaded = 0;
+	for (int i = 1; i <= READAROUND; i++) {
+		for (int near = page - i; near <= page + i; near += 2 * i) {
+			if (near < 0 || near >= SHMFIRST) continue;
+			if (vmSpaceOf(pid) -> pageTable[near].incore 
+					|| vmSpaceOf(pid) -> pageInfos[near].swapSlot == NOSWAP) 
+				continue;
+			int frame = vmFreeFrame();
+			if (frame == -1) {
+				statRecord(statReadAround, loaded);
+				return;
+			}
+			vmLoadPage(pid, near, frame);
+			loaded++;
+		}
+	}
+	statRecord(statReadAround, loaded);
+}
+
+/*
+ * A write to a page shared since fork(), give the process its own copy
+ * The last process left sharing the frame keeps it without copying
+ */
+void vmCopyOnWrite(int pid, int page) {
+	int start = statStart();
+	USLOSS_PTE *pte = &vmSpaceOf(pid) -> pageTable[page];
+	pageInfo *info = &vmSpaceOf(pid) -> pageInfos[page];
+	// the page may have been evicted before the request was taken
+	if (! pte -> incore) vmLoadPage(pid, page, vmFindFrame());
+	int old = pte -> frame;
+	if (frames[old].refCount > 1) {
+		// the old frame cannot be picked as the victim while it is busy
+		frames[old].busy = 1;
+		int frame = vmFindFrame();
+		memcpy(vmMapScratch(SCRATCHDST, frame), vmMapScratch(SCRATCHSRC, old), pageSize);
+		vmUnmapScratch();
+		frames[old].busy = 0;
+		frames[old].refCount--;
+		frames[frame].refCount = 1;
+		frames[frame].page = page;
+		frames[frame].busy = 0;
+		pte -> frame = frame;
+		statLatency(statCowCopy, start);
+	}
+	// our copy will differ from the shared swap copy
+	if (info -> swapSlot != NOSWAP && swapRefs[info -> swapSlot] > 1) {
+		vmSwapFree(info -> swapSlot);
+		info -> swapSlot = NOSWAP;
+	}
+	info -> cow = 0;
+	pte -> write = 1;
+}
+
+/*
+ * Return a free frame marked busy, -1 if every frame is in use
+ */
+int vmFreeFrame() {
+	for (int i = 0; i < VMFRAMES; i++) {
+		if (frames[i].refCount == 0 && ! frames[i].busy) {
+			frames[i].busy = 1;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Return a frame to put the page in, a free one if possible, otherwise the
+ * first one CLOCK finds not referenced since the hand last passed it
+ * The frame comes back marked busy
+ */
+int vmFindFrame() {
+	int free = vmFreeFrame();
+	if (free != -1) return free;
+	while (1) {
+		int frame = clockHand;
+		clockHand = (clockHand + 1) % VMFRAMES;
+		if (frames[frame].busy) continue;
+		int access;
+		USLOSS_MmuGetAccess(frame, &access);
+		if (access & USLOSS_MMU_REF) {
+			// second chance
+			USLOSS_MmuSetAccess(frame, access & ~USLOSS_MMU_REF);
+			continue;
+		}
+		frames[frame].busy = 1;
+		vmEvict(frame);
+		return frame;
+	}
+}
+
+/*
+ * Take a frame away from every process mapping it, writing the page out if
+ * the swap copy is missing or stale
+ * Every owner gets the slot before it loses the frame, mmu_fork() does not
+ * take vmLock and must never see a page that is neither in core nor in swap
+ * A fault on the slot waits for vmLock, so it never reads it before the
+ * write below is done
+ */
+void vmEvict(int frame) {
+	int ownerPage = frames[frame].page;
+	int shm = frames[frame].shm;
+	int numOwners = 0;
+	int slot = NOSWAP;
+	for (int i = 0; i < procTableSize(); i++) {
+		vmSpace *space = vmSpaceOf(i);
+		USLOSS_PTE *pte = &space -> pageTable[ownerPage];
+		if (! pte -> incore || pte -> frame != frame) continue;
+		numOwners++;
+		slot = space -> pageInfos[ownerPage].swapSlot;
+	}
+	// a region page goes to the region's slot, the mappers keep none
+	int index = 0;
+	if (shm != NOSHM) {
+		index = ownerPage - shmRegions[shm].firstPage;
+		slot = shmRegions[shm].swapSlot[index];
+	}
+	statRecord(statEvict, numOwners);
+	int access;
+	USLOSS_MmuGetAccess(frame, &access);
+	int write = (access & USLOSS_MMU_DIRTY) || slot == NOSWAP;
+	if (slot == NOSWAP) {
+		slot = vmSwapAlloc();
+		if (shm != NOSHM) shmRegions[shm].swapSlot[index] = slot;
+		else swapRefs[slot] = numOwners;
+	}
+	// every owner already had the slot unless it was just allocated
+	for (int i = 0; i < procTableSize(); i++) {
+		vmSpace *space = vmSpaceOf(i);
+		USLOSS_PTE *pte = &space -> pageTable[ownerPage];
+		if (! pte -> incore || pte -> frame != frame) continue;
+		if (shm == NOSHM) space -> pageInfos[ownerPage].swapSlot = slot;
+		pte -> incore = 0;
+	}
+	if (shm != NOSHM) {
+		shmRegions[shm].frame[index] = -1;
+		frames[frame].shm = NOSHM;
+	}
+	if (write) {
+		memcpy(vmBounce, vmMapScratch(SCRATCHSRC, frame), pageSize);
+		vmUnmapScratch();
+		vmSwapIO(slot, WRITE);
+	}
+	frames[frame].refCount = 0;
+}
+
+/*
+ * Fill a frame with the page and map it, from swap if the page was written
+ * out before, zero filled otherwise
+ */
+void vmLoadPage(int pid, int page, int frame) {
+	int slot = vmSpaceOf(pid) -> pageInfos[page].swapSlot;
+	if (slot != NOSWAP) {
+		vmSwapIO(slot, READ);
+		memcpy(vmMapScratch(SCRATCHDST, frame), vmBounce, pageSize);
+	} else memset(vmMapScratch(SCRATCHDST, frame), 0, pageSize);
+	vmUnmapScratch();
+	// the copy above touched the frame, the swap copy is still good
+	USLOSS_MmuSetAccess(frame, 0);
+	USLOSS_PTE *pte = &vmSpaceOf(pid) -> pageTable[page];
+	pte -> incore = 1;
+	pte -> read = 1;
+	pte -> write = 1;
+	pte -> frame = frame;
+	// a swap copy other processes still use must be copied before writing
+	pageInfo *info = &vmSpaceOf(pid) -> pageInfos[page];
+	if (info -> cow) {
+		if (slot != NOSWAP && swapRefs[slot] > 1) pte -> write = 0;
+		else info -> cow = 0;
+	}
+	frames[frame].refCount = 1;
+	frames[frame].page = page;
+	frames[frame].busy = 0;
+}
+
+/*
+ * Map a frame at a scratch page of the running pager and return the address
+ * it can be reached at
+ */
+void *vmMapScratch(int scratch, int frame) {
+	USLOSS_PTE *pte = &vmSpaceOf(getpid()) -> pageTable[scratch];
+	pte -> incore = 1;
+	pte -> read = 1;
+	pte -> write = 1;
+	pte -> frame = frame;
+	USLOSS_MmuSetPageTable(vmSpaceOf(getpid()) -> pageTable);
+	return (char *) vmRegion + scratch * pageSize;
+}
+
+/*
+ * Unmap both scratch pages of the running pager, vmEvict() would take a
+ * scratch mapping for one of the frame's owners
+ */
+void vmUnmapScratch() {
+	USLOSS_PTE *table = vmSpaceOf(getpid()) -> pageTable;
+	memset(&table[SCRATCHSRC], 0, sizeof(USLOSS_PTE));
+	memset(&table[SCRATCHDST], 0, sizeof(USLOSS_PTE));
+	USLOSS_MmuSetPageTable(table);
+}
+
+/*
+ * Reserve a page sized slot on the swap disk
+ */
+int vmSwapAlloc() {
+	for (int i = 0; i < numSwapSlots; i++) {
+		if (swapRefs[i] == 0) {
+			swapRefs[i] = 1;
+			return i;
+		}
+	}
+	USLOSS_Console("ERROR: Out of swap space on disk %d.\n", SWAPDISK);
+	USLOSS_Halt(1);
+	return NOSWAP;
+}
+
+/*
+ * Drop one reference to a swap slot, NOSWAP is ignored
+ */
+void vmSwapFree(int slot) {
+	if (slot != NOSWAP && swapRefs[slot] > 0) swapRefs[slot]--;
+}
+
+/*
+ * Drop one reference to a frame, it is free once nobody maps it
+ */
+void vmFrameRelease(int frame) {
+	if (frames[frame].refCount == 0) return;
+	if (--frames[frame].refCount == 0) USLOSS_MmuSetAccess(frame, 0);
+}
+
+/*
+ * Move one page between vmBounce and its swap slot through the disk driver
+ * A page may span more than one track
+ */
+void vmSwapIO(int slot, int type) {
+	int start = statStart();
+	if (type == READ) swapReads++;
+	int sector = slot * sectorsPerPage;
+	int left = sectorsPerPage;
+	char *buffer = vmBounce;
+	while (left > 0) {
+		int track = sector / USLOSS_DISK_TRACK_SIZE;
+		int first = sector % USLOSS_DISK_TRACK_SIZE;
+		int blocks = USLOSS_DISK_TRACK_SIZE - first;
+		if (blocks > left) blocks = left;
+		int status;
+		if (diskRequestHelper(buffer, SWAPDISK, track, first, blocks, &status, type) != 0
+				|| status != 0) {
+			USLOSS_Console("ERROR: Swap %s failed on disk %d track %d.\n",
+							type == READ ? "read" : "write", SWAPDISK, track);
+			USLOSS_Halt(1);
+		}
+		sector += blocks;
+		left -= blocks;
+		buffer += blocks * USLOSS_DISK_SECTOR_SIZE;
+	}
+	statLatency(type == READ ? statSwapIn : statSwapOut, start);
+}
+
+/*
+ * The SYS_SHMCREATE handler
+ * System Call Inputs:
+ * 		arg1: size of the region in bytes
+ * System Call Outputs: 
+ * 		arg1: ID of the region
+ * 		arg4: -1 if the size is illegal or no room is left, 0 otherwise
+ */
+void shmCreate(systemArgs *args) {
+	int id = -1;
+	int re = shmCreateHelper((long) args -> arg1, &id);
+	args -> arg1 = (void*)(long) id;
+	args -> arg4 = (void*)(long) re;
+}
+
+/*
+ * The actual SYS_SHMCREATE handler, the region takes the first run of free
+ * pages in the shared window, every page starts out zero filled
+ * @return: 	   -1, if illegal values were given as input or no room left
+ * 					0, otherwise
+ */
+int shmCreateHelper(int size, int *idOut) {
+	int numPages = (size + pageSize - 1) / pageSize;
+	if (size <= 0 || numPages > SHMPAGES) return -1;
+	MboxSend(vmLock, NULL, 0);
+	int id = -1;
+	for (int i = 0; i < MAXSHM && id == -1; i++)
+		if (shmRegions[i].status == EMPTY) id = i;
+	int first = -1;
+	for (int i = 0; i + numPages <= SHMPAGES && id != -1 && first == -1; i++) {
+		int run = 0;
+		while (run < numPages && shmPageOwner[i + run] == NOSHM) run++;
+		if (run == numPages) first = i;
+	}
+	if (first == -1) {
+		MboxReceive(vmLock, NULL, 0);
+		return -1;
+	}
+	shmRegion *region = &shmRegions[id];
+	region -> status = OCCUPIED;
+	region -> firstPage = SHMFIRST + first;
+	region -> numPages = numPages;
+	region -> mappers = 0;
+	region -> destroyed = 0;
+	for (int i = 0; i < SHMPAGES; i++) {
+		region -> frame[i] = -1;
+		region -> swapSlot[i] = NOSWAP;
+	}
+	for (int i = 0; i < numPages; i++) shmPageOwner[first + i] = id;
+	MboxReceive(vmLock, NULL, 0);
+	*idOut = id;
+	return 0;
+}
+
+/*
+ * The SYS_SHMMAP handler
+ * System Call Inputs:
+ * 		arg1: ID of the region
+ * System Call Outputs: 
+ * 		arg1: address the region starts at, the same in every process
+ * 		arg4: -1 if the ID is illegal or the region was destroyed, 0 otherwise
+ */
+void shmMap(systemArgs *args) {
+	void *addr = NULL;
+	int re = shmMapHelper((long) args -> arg1, &addr);
+	args -> arg1 = addr;
+	args -> arg4 = (void*)(long) re;
+}
+
+/*
+ * The actual SYS_SHMMAP handler, pages come in on the first touch
+ * Mapping a region twice is the same as mapping it once
+ * @return: 	   -1, if illegal values were given as input
+ * 					0, otherwise
+ */
+int shmMapHelper(int id, void **addrOut) {
+	if (id < 0 || id >= MAXSHM) return -1;
+	MboxSend(vmLock, NULL, 0);
+	shmRegion *region = &shmRegions[id];
+	if (region -> status == EMPTY || region -> destroyed) {
+		MboxReceive(vmLock, NULL, 0);
+		return -1;
+	}
+	pageInfo *infos = vmSpaceOf(getpid()) -> pageInfos;
+	if (infos[region -> firstPage].shm != id) {
+		for (int i = 0; i < region -> numPages; i++) 
+			infos[region -> firstPage + i].shm = id;
+		region -> mappers++;
+	}
+	*addrOut = (char *) vmRegion + region -> firstPage * pageSize;
+	MboxReceive(vmLock, NULL, 0);
+	return 0;
+}
+
+/*
+ * The SYS_SHMUNMAP handler
+ * System Call Inputs:
+ * 		arg1: ID of the region
+ * System Call Outputs: 
+ * 		arg4: -1 if the region is not mapped by this process, 0 otherwise
+ */
+void shmUnmap(systemArgs *args) {
+	int re = shmUnmapHelper((long) args -> arg1);
+	args -> arg4 = (void*)(long) re;
+}
+
+/*
+ * The actual SYS_SHMUNMAP handler
+ * @return: 	   -1, if illegal values were given as input
+ * 					0, otherwise
+ */
+int shmUnmapHelper(int id) {
+	if (id < 0 || id >= MAXSHM) return -1;
+	MboxSend(vmLock, NULL, 0);
+	int pid = getpid();
+	shmRegion *region = &shmRegions[id];
+	if (region -> status == EMPTY 
+			|| vmSpaceOf(pid) -> pageInfos[region -> firstPage].shm != id) {
+		MboxReceive(vmLock, NULL, 0);
+		return -1;
+	}
+	shmDetach(pid, id);
+	MboxReceive(vmLock, NULL, 0);
+	return 0;
+}
+
+/*
+ * The SYS_SHMDESTROY handler
+ * System Call Inputs:
+ * 		arg1: ID of the region
+ * System Call Outputs: 
+ * 		arg4: -1 if the ID is illegal, 0 otherwise
+ */
+void shmDestroy(systemArgs *args) {
+	int re = shmDestroyHelper((long) args -> arg1);
+	args -> arg4 = (void*)(long) re;
+}
+
+/*
+ * The actual SYS_SHMDESTROY handler, processes still mapping the region
+ * keep it until they unmap it or quit, nobody can map it anymore
+ * @return: 	   -1, if illegal values were given as input
+ * 					0, otherwise
+ */
+int shmDestroyHelper(int id) {
+	if (id < 0 || id >= MAXSHM) return -1;
+	MboxSend(vmLock, NULL, 0);
+	shmRegion *region = &shmRegions[id];
+	if (region -> status == EMPTY || region -> destroyed) {
+		MboxReceive(vmLock, NULL, 0);
+		return -1;
+	}
+	region -> destroyed = 1;
+	if (region -> mappers == 0) shmFree(id);
+	MboxReceive(vmLock, NULL, 0);
+	return 0;
+}
+
+/*
+ * Map a region page at the faulting page, from the region's frame if it is
+ * in core, otherwise from its swap slot or zero filled
+ */
+void shmLoadPage(int pid, int page) {
+	pageInfo *info = &vmSpaceOf(pid) -> pageInfos[page];
+	shmRegion *region = &shmRegions[info -> shm];
+	int index = page - region -> firstPage;
+	if (region -> frame[index] == -1) {
+		int frame = vmFindFrame();
+		if (region -> swapSlot[index] != NOSWAP) {
+			vmSwapIO(region -> swapSlot[index], READ);
+			memcpy(vmMapScratch(SCRATCHDST, frame), vmBounce, pageSize);
+		} else memset(vmMapScratch(SCRATCHDST, frame), 0, pageSize);
+		vmUnmapScratch();
+		USLOSS_MmuSetAccess(frame, 0);
+		// the region's own reference
+		frames[frame].refCount = 1;
+		frames[frame].page = page;
+		frames[frame].shm = info -> shm;
+		frames[frame].busy = 0;
+		region -> frame[index] = frame;
+	}
+	USLOSS_PTE *pte = &vmSpaceOf(pid) -> pageTable[page];
+	pte -> incore = 1;
+	pte -> read = 1;
+	pte -> write = 1;
+	pte -> frame = region -> frame[index];
+	frames[region -> frame[index]].refCount++;
+}
+
+/*
+ * Remove a region from the address space of a process, the region is freed
+ * if it was destroyed and this was its last mapper
+ * Never blocks, quit() calls it through mmu_quit()
+ */
+void shmDetach(int pid, int id) {
+	shmRegion *region = &shmRegions[id];
+	for (int i = 0; i < region -> numPages; i++) {
+		USLOSS_PTE *pte = &vmSpaceOf(pid) -> pageTable[region -> firstPage + i];
+		if (pte -> incore) vmFrameRelease(pte -> frame);
+		memset(pte, 0, sizeof(USLOSS_PTE));
+		vmSpaceOf(pid) -> pageInfos[region -> firstPage + i].shm = NOSHM;
+	}
+	if (pid == getpid()) USLOSS_MmuSetPageTable(vmSpaceOf(pid) -> pageTable);
+	region -> mappers--;
+	if (region -> destroyed && region -> mappers == 0) shmFree(id);
+}
+
+/*
+ * Give back the frames, swap slots and window pages of a region
+ * A frame being written out right now was already taken from the region
+ */
+void shmFree(int id) {
+	shmRegion *region = &shmRegions[id];
+	for (int i = 0; i < region -> numPages; i++) {
+		if (region -> frame[i] != -1) {
+			frames[region -> frame[i]].shm = NOSHM;
+			vmFrameRelease(region -> frame[i]);
+		}
+		vmSwapFree(region -> swapSlot[i]);
+		shmPageOwner[region -> firstPage - SHMFIRST + i] = NOSHM;
+	}
+	region -> status = EMPTY;
+}
+
+/*
+ * The SYS_VMSTATS handler
+ * System Call Inputs:
+ * 		arg1: PID of the process, the caller if 0
+ * 		arg2: pointer to a vmStatsArgs to fill in
+ * System Call Outputs: 
+ * 		arg4: -1 if there is no such process or paging is off, 0 otherwise
+ */
+void vmStats(systemArgs *args) {
+	int pid = (long) args -> arg1;
+	vmStatsArgs *out = (vmStatsArgs *) args -> arg2;
+	if (pid == 0) pid = getpid();
+	int re = -1;
+	if (out != NULL) 
+		re = vmStatsHelper(pid, &out -> rss, &out -> majorFaults, &out -> minorFaults,
+							&out -> refPages, &out -> dirtyPages);
+	args -> arg4 = (void*)(long) re;
+}
+
+/*
+ * The actual SYS_VMSTATS handler, also dumpProc()'s paging stats hook
+ * Never blocks, the resident set is counted from the page table
+ * @return: 	   -1, if paging is off or the process is gone
+ * 					0, otherwise
+ */
+int vmStatsHelper(int pid, int *rss, int *major, int *minor, int *ref, int *dirty) {
+	if (! vmStarted || pid <= 0 || vmSpaceOf(pid) -> pid != pid) return -1;
+	vmSpace *space = vmSpaceOf(pid);
+	*rss = 0;
+	for (int i = 0; i < VMPAGES; i++) 
+		if (space -> pageTable[i].incore) (*rss)++;
+	*major = space -> stats.majorFaults;
+	*minor = space -> stats.minorFaults;
+	*ref = space -> stats.refPages;
+	*dirty = space -> stats.dirtyPages;
+	return 0;
+}
+
+/*
+ * Return the address space of a process, or of a slot of the process table
+ */
+vmSpace *vmSpaceOf(int pid) {
+	return procShadow(vmSpaces, pid);
+}
+
+/*
+ * Return the mailbox the faults of a process are answered on, it is made
+ * on the first fault since most processes never fault
+ */
+int vmReplyMbox(int pid) {
+	vmSpace *space = vmSpaceOf(pid);
+	if (! space -> hasReply) {
+		space -> reply = MboxCreate(1, 0);
+		space -> hasReply = 1;
+	}
+	return space -> reply;
+}
+/* ------------------------------------------------------------------------- */